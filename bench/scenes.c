@@ -0,0 +1,294 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define WARMUP_FRAMES 5
+#define DEFAULT_FRAMES 100
+#define MAX_FRAMES 500
+#define PANELS 8
+
+typedef struct
+{
+    const char* name;
+    int count;
+    void (*render)();
+} scene;
+
+static void render_rects();
+static void render_lines();
+static void render_text();
+static void render_overlap();
+static void render_colors();
+static void render_plot();
+static void render_panels();
+
+/* every scene draws the same primitives every frame */
+static const scene scenes[] = {
+    { "rects", 10000, render_rects },
+    { "lines", 5000, render_lines },
+    { "text", 1000, render_text },
+    { "overlap", 200, render_overlap },
+    { "colors", 10000, render_colors },
+    { "plot", 1000000, render_plot },
+    { "panels", 80000, render_panels },
+};
+
+static const scene* current;
+static unsigned int seed;
+
+static unsigned int next_random()
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static int random_below(int n)
+{
+    return (int)(next_random() % (unsigned int)n);
+}
+
+static void render_rects()
+{
+    int i;
+    seed = 1;
+    ng_set_color(0x3070C0FF);
+    for (i = 0; i < current->count; ++i)
+    {
+        int x = random_below(WIDTH - 64), y = random_below(HEIGHT - 64);
+        ng_draw_rectangle(x, y, x + 1 + random_below(64), y + 1 + random_below(64));
+    }
+}
+
+static void render_lines()
+{
+    int i;
+    seed = 2;
+    ng_set_color(0xE0E040FF);
+    for (i = 0; i < current->count; ++i)
+    {
+        int x = random_below(WIDTH), y = random_below(HEIGHT);
+        ng_draw_line(x, y, x + random_below(200) - 100,
+                     y + random_below(200) - 100, 5);
+    }
+}
+
+static void render_text()
+{
+    int i;
+    seed = 3;
+    ng_set_color(0xFFFFFFFF);
+    for (i = 0; i < current->count; ++i)
+        ng_draw_text(random_below(WIDTH - 200), random_below(HEIGHT),
+                     "The quick brown fox 0123");
+}
+
+static void render_overlap()
+{
+    int i;
+    seed = 4;
+    for (i = 0; i < current->count; ++i)
+    {
+        ng_set_color(0x40808020 | (unsigned int)random_below(0x100) << 24);
+        int x = random_below(WIDTH / 4), y = random_below(HEIGHT / 4);
+        ng_draw_rectangle(x, y, x + WIDTH / 2, y + HEIGHT / 2);
+    }
+}
+
+static void render_colors()
+{
+    int i;
+    seed = 5;
+    for (i = 0; i < current->count; ++i)
+    {
+        ng_set_color(next_random() << 8 | 0xFF);
+        int x = random_below(WIDTH - 16), y = random_below(HEIGHT - 16);
+        ng_draw_rectangle(x, y, x + 16, y + 16);
+    }
+}
+
+// a noisy signal with over a thousand samples per pixel column, drawn
+// with decimation
+static void render_plot()
+{
+    static ng_point* points;
+    int i;
+    if (points == NULL)
+    {
+        points = malloc(current->count * sizeof(ng_point));
+        if (points == NULL)
+            return;
+        seed = 6;
+        for (i = 0; i < current->count; ++i)
+        {
+            points[i].x = (int)((long long)i * WIDTH / current->count);
+            points[i].y = HEIGHT / 2 + (i / 4000 % 2 ? 150 : -150) +
+                          random_below(100);
+        }
+        ng_set_decimation(1);
+    }
+    ng_set_color(0x40FF40FF);
+    ng_draw_polyline(points, current->count, 2);
+}
+
+static ng_command_list* panel_lists[PANELS];
+static int panel_threads;
+static pthread_barrier_t panels_start;
+static pthread_barrier_t panels_done;
+
+// every worker records its share of the panels, a panel being a strip
+// of small rectangles in a color of its own
+static void record_panels(int first)
+{
+    int panel, i;
+    for (panel = first; panel < PANELS; panel += panel_threads)
+    {
+        unsigned int r = panel * 2654435761u;
+        int x0 = panel * WIDTH / PANELS, width = WIDTH / PANELS - 16;
+        ng_begin_command_list(panel_lists[panel]);
+        ng_set_color(r | 0xFF);
+        for (i = 0; i < current->count / PANELS; ++i)
+        {
+            r = r * 1664525u + 1013904223u;
+            int x = x0 + (int)(r >> 8) % width;
+            int y = (int)(r >> 12) % (HEIGHT - 8);
+            ng_draw_rectangle(x, y, x + 8, y + 8);
+        }
+        ng_end_command_list();
+    }
+}
+
+// the workers live as long as the process and record once a frame
+static void* panel_worker(void* arg)
+{
+    for (;;)
+    {
+        pthread_barrier_wait(&panels_start);
+        record_panels((int)(size_t)arg);
+        pthread_barrier_wait(&panels_done);
+    }
+    return NULL;
+}
+
+// records the panels on NG_THREADS threads, started with the first
+// frame so only the recording is measured, and draws them in order
+static void render_panels()
+{
+    int i;
+    if (panel_lists[0] == NULL)
+    {
+        pthread_t thread;
+        const char* threads_env = getenv("NG_THREADS");
+        panel_threads = threads_env != NULL ? atoi(threads_env) : 1;
+        if (panel_threads < 1)
+            panel_threads = 1;
+        if (panel_threads > PANELS)
+            panel_threads = PANELS;
+        for (i = 0; i < PANELS; ++i)
+            panel_lists[i] = ng_create_command_list();
+        pthread_barrier_init(&panels_start, NULL, panel_threads);
+        pthread_barrier_init(&panels_done, NULL, panel_threads);
+        for (i = 1; i < panel_threads; ++i)
+        {
+            if (pthread_create(&thread, NULL, panel_worker,
+                               (void*)(size_t)i) != 0)
+            {
+                fprintf(stderr, "pthread_create failed\n");
+                exit(1);
+            }
+        }
+    }
+
+    pthread_barrier_wait(&panels_start);
+    record_panels(0);
+    pthread_barrier_wait(&panels_done);
+
+    for (i = 0; i < PANELS; ++i)
+        ng_draw_command_list(panel_lists[i]);
+}
+
+static void on_update(int dt)
+{
+    (void)dt;
+}
+
+static int compare_us(const void* a, const void* b)
+{
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// frame times come from the profiler: update, render and present; the
+// software backend unless NG_BACKEND picks a GL one, drawn without a
+// window
+static void run_scene(const scene* s, int frames)
+{
+    static long long times[MAX_FRAMES];
+    long long total = 0;
+    int i;
+
+    current = s;
+    if (getenv("NG_BACKEND") == NULL)
+        ng_set_backend(NG_BACKEND_SOFTWARE);
+    ng_set_headless(1);
+    ng_set_frame_limit(WARMUP_FRAMES + frames);
+    ng_init_graphics(WIDTH, HEIGHT, s->name, on_update, s->render);
+
+    for (i = 0; i < frames; ++i)
+    {
+        ng_frame_stats stats;
+        if (!ng_get_frame_stats(i, &stats))
+            break;
+        times[i] = stats.update_us + stats.render_us + stats.swap_us;
+        total += times[i];
+    }
+    frames = i;
+    qsort(times, frames, sizeof(times[0]), compare_us);
+
+    double fps = total > 0 ? frames * 1e6 / total : 0.0;
+    const char* threads = getenv("NG_THREADS");
+    printf("%s,%d,%s,%d,%.1f,%.0f,%.3f,%.3f\n", s->name, s->count,
+           threads != NULL ? threads : "1", frames, fps, fps * s->count,
+           times[frames / 2] / 1e3, times[(frames * 99) / 100] / 1e3);
+}
+
+// runs every scene, or the ones named on the command line, each in its
+// own process; BENCH_FRAMES sets the measured frames (default 100)
+int main(int argc, char** argv)
+{
+    int frames = DEFAULT_FRAMES;
+    int count = sizeof(scenes) / sizeof(scenes[0]);
+    int i, j;
+
+    if (getenv("BENCH_FRAMES") != NULL)
+        frames = atoi(getenv("BENCH_FRAMES"));
+    if (frames < 1 || frames > MAX_FRAMES)
+        frames = DEFAULT_FRAMES;
+
+    printf("scene,count,threads,frames,fps,prims_per_s,p50_ms,p99_ms\n");
+    fflush(stdout);
+    for (i = 0; i < count; ++i)
+    {
+        int selected = argc <= 1;
+        for (j = 1; j < argc; ++j)
+            selected |= strcmp(argv[j], scenes[i].name) == 0;
+        if (!selected)
+            continue;
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run_scene(&scenes[i], frames);
+            fflush(stdout);
+            _exit(0);
+        }
+        if (pid > 0)
+            waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
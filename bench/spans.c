@@ -0,0 +1,140 @@
+#include "../src/internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MIN_SECONDS 0.5
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// full-screen passes until MIN_SECONDS elapsed, returns seconds per pass
+static double measure(ng_span_func f, GLubyte* pixels, const GLubyte* color)
+{
+    int passes = 0;
+    double start = now();
+    double elapsed;
+    do
+    {
+        int y;
+        for (y = 0; y < HEIGHT; ++y)
+            f(pixels + (size_t)y * WIDTH * 4, WIDTH, color);
+        ++passes;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    return elapsed / passes;
+}
+
+// odd lengths and offsets exercise the scalar tails of every kernel
+static int matches_scalar(const ng_span_kernels* k, const ng_span_kernels* ref)
+{
+    static const GLubyte color[4] = { 0x00, 0xAA, 0x00, 0x55 };
+    GLubyte a[4 * 67], b[4 * 67];
+    int i, n;
+    for (n = 0; n < 64; ++n)
+    {
+        for (i = 0; i < (int)sizeof(a); ++i)
+            a[i] = b[i] = (GLubyte)(i * 37 + n);
+        k->blend(a + 4, n, color);
+        ref->blend(b + 4, n, color);
+        k->fill(a + 8 + 4 * n, 1 + n % 3, color);
+        ref->fill(b + 8 + 4 * n, 1 + n % 3, color);
+        if (memcmp(a, b, sizeof(a)) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+// a frame converted two rows at a time, like the Y4M stream does
+static double measure_i420(ng_i420_func f, const GLubyte* pixels,
+                           unsigned char* planes)
+{
+    int passes = 0;
+    double start = now();
+    double elapsed;
+    unsigned char* u = planes + WIDTH * HEIGHT;
+    unsigned char* v = u + WIDTH / 2 * HEIGHT / 2;
+    do
+    {
+        int y;
+        for (y = 0; y < HEIGHT; y += 2)
+            f(pixels + (size_t)y * WIDTH * 4, pixels + (size_t)(y + 1) * WIDTH * 4,
+              WIDTH, planes + (size_t)y * WIDTH, planes + (size_t)(y + 1) * WIDTH,
+              u + y / 2 * WIDTH / 2, v + y / 2 * WIDTH / 2);
+        ++passes;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    return elapsed / passes;
+}
+
+// every width up to 40 covers the tails and odd widths
+static int i420_matches_scalar(ng_i420_func f, ng_i420_func ref)
+{
+    GLubyte rows[2][4 * 40];
+    unsigned char a[120], b[120];
+    int i, n;
+    for (n = 1; n <= 40; ++n)
+    {
+        for (i = 0; i < (int)sizeof(rows); ++i)
+            rows[i / (4 * 40)][i % (4 * 40)] = (GLubyte)(i * 97 + n * 13);
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        f(rows[0], rows[1], n, a, a + 40, a + 80, a + 100);
+        ref(rows[0], rows[1], n, b, b + 40, b + 80, b + 100);
+        if (memcmp(a, b, sizeof(a)) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+int main()
+{
+    static const GLubyte opaque[4] = { 0xFF, 0x00, 0x00, 0xFF };
+    static const GLubyte overlay[4] = { 0x00, 0xAA, 0x00, 0x55 };
+    int count, i;
+    const ng_span_kernels* kernels = ng_get_span_kernels(&count);
+    GLubyte* pixels = malloc((size_t)WIDTH * HEIGHT * 4);
+    if (pixels == NULL)
+        return 1;
+    memset(pixels, 0x40, (size_t)WIDTH * HEIGHT * 4);
+
+    printf("%-8s %14s %14s %12s %12s %6s\n", "kernel", "fill Mpix/s",
+           "blend Mpix/s", "fill ms", "blend ms", "exact");
+    for (i = 0; i < count; ++i)
+    {
+        double fill = measure(kernels[i].fill, pixels, opaque);
+        double blend = measure(kernels[i].blend, pixels, overlay);
+        double mpix = (double)WIDTH * HEIGHT / 1e6;
+        printf("%-8s %14.1f %14.1f %12.3f %12.3f %6s\n", kernels[i].name,
+               mpix / fill, mpix / blend, fill * 1e3, blend * 1e3,
+               matches_scalar(&kernels[i], &kernels[0]) ? "yes" : "NO");
+    }
+
+    const ng_i420_kernels* i420 = ng_get_i420_kernels(&count);
+    unsigned char* planes = malloc((size_t)WIDTH * HEIGHT * 3 / 2);
+    if (planes == NULL)
+        return 1;
+    for (i = 0; i < WIDTH * HEIGHT * 4; ++i)
+        pixels[i] = (GLubyte)(i * 29 + (i >> 12));
+    printf("\n%-8s %14s %12s %6s\n", "kernel", "i420 Mpix/s", "i420 ms",
+           "exact");
+    for (i = 0; i < count; ++i)
+    {
+        double convert = measure_i420(i420[i].rows, pixels, planes);
+        printf("%-8s %14.1f %12.3f %6s\n", i420[i].name,
+               (double)WIDTH * HEIGHT / 1e6 / convert, convert * 1e3,
+               i420_matches_scalar(i420[i].rows, i420[0].rows) ? "yes" : "NO");
+    }
+
+    free(planes);
+
+    free(pixels);
+    return 0;
+}
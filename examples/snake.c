@@ -138,11 +138,10 @@ void on_update(int dt)
 
 void render_mainmenu()
 {
-    // FIXME: wtf am i doing here, lol? fix ng_draw_text
-    ng_set_color(0x00FF00FF);
-    ng_draw_line(-WINDOW_WIDTH / 2, 0, 800, 30, 3);
+    static const char* text = "Press Enter to start";
     ng_set_color(0x00FFFFFF);
-    ng_draw_text(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, "Press Enter to start");
+    ng_draw_text(WINDOW_WIDTH / 2 - (int)strlen(text) * 9 / 2,
+                 WINDOW_HEIGHT / 2, text);
 }
 
 void render_field()
@@ -95,6 +95,11 @@ struct Figure
 
 enum CellType field[FIELD_WIDTH][FIELD_HEIGHT];
 
+// the board is recorded once and only the cells that changed are redrawn
+ng_geometry* board;
+int board_marks[FIELD_WIDTH][FIELD_HEIGHT];
+enum CellType board_cells[FIELD_WIDTH][FIELD_HEIGHT];
+
 enum Direction
 {
     Down,
@@ -295,6 +300,7 @@ void set_next_figure()
 
 void destroy_game()
 {
+    ng_free_geometry(board);
 }
 
 void init_game()
@@ -317,30 +323,52 @@ void render_cell(int x, int y, unsigned int color)
                       (y + 1) * CELL_WIDTH - CELL_DELIMETER);
 }
 
+unsigned int cell_color(enum CellType type)
+{
+    switch (type)
+    {
+    case Brick:
+        return CELL_BRICK_COLOR;
+    case Wall:
+        return CELL_WALL_COLOR;
+    default:
+        return CELL_NONE_COLOR;
+    }
+}
+
 void on_render()
 {
     int x, y;
 
-    for (x = 0; x < FIELD_WIDTH; ++x)
+    if (board == NULL)
     {
-        for (y = 0; y < FIELD_HEIGHT; ++y)
+        board = ng_begin_geometry();
+        for (x = 0; x < FIELD_WIDTH; ++x)
         {
-            unsigned int color;
-            switch (field[x][y])
+            for (y = 0; y < FIELD_HEIGHT; ++y)
             {
-            case None:
-                color = CELL_NONE_COLOR;
-                break;
-            case Brick:
-                color = CELL_BRICK_COLOR;
-                break;
-            case Wall:
-                color = CELL_WALL_COLOR;
-                break;
+                board_marks[x][y] = ng_geometry_mark();
+                board_cells[x][y] = field[x][y];
+                render_cell(x, y, cell_color(field[x][y]));
             }
-            render_cell(x, y, color);
+        }
+        ng_end_geometry();
+    }
+
+    for (x = 0; x < FIELD_WIDTH; ++x)
+    {
+        for (y = 0; y < FIELD_HEIGHT; ++y)
+        {
+            if (board_cells[x][y] == field[x][y])
+                continue;
+            board_cells[x][y] = field[x][y];
+            ng_begin_geometry_update(board, board_marks[x][y]);
+            render_cell(x, y, cell_color(field[x][y]));
+            ng_end_geometry();
         }
     }
+
+    ng_draw_geometry(board);
 }
 
 void strike(int line_y)
@@ -7,26 +7,278 @@
 
 #define RELEASED GLUT_UP
 #define PRESSED GLUT_DOWN
+/* the state of NG_EVENT_MOUSE_MOVE events, apart from GLUT_UP and
+   GLUT_DOWN */
+#define MOVED 2
+
+#define NG_EVENT_KEY_PRESS 1
+#define NG_EVENT_KEY_RELEASE 2
+#define NG_EVENT_MOUSE_BUTTON 3
+#define NG_EVENT_MOUSE_MOVE 4
+
+#define NG_BACKEND_OPENGL 0
+#define NG_BACKEND_SOFTWARE 1
+#define NG_BACKEND_GL33 2
+
+#define NG_CAP_BUTT 0
+#define NG_CAP_SQUARE 1
+#define NG_CAP_ROUND 2
 
 #include <GL/glew.h>
 #include <GL/glut.h>
 
+typedef struct
+{
+    int type;
+    long long time_us;      /* ng_get_time_us() when it arrived */
+    int x, y;               /* mouse position */
+    int button;             /* NG_EVENT_MOUSE_BUTTON */
+    int state;              /* PRESSED, RELEASED or MOVED */
+    unsigned char key;      /* NG_EVENT_KEY_PRESS and NG_EVENT_KEY_RELEASE */
+} ng_event;
+
+/* corners and 0xRRGGBBAA color of one element for the bulk calls */
+typedef struct
+{
+    int x0, y0, x1, y1;
+    unsigned int color;
+} ng_rect;
+
+typedef struct
+{
+    int x0, y0, x1, y1;
+    unsigned int color;
+} ng_line;
+
+typedef struct
+{
+    int x, y;
+} ng_point;
+
+/* what one rendered frame cost; updates are the fixed steps run since
+   the frame before, a state change is a switch of shader, primitive type
+   or line width between two draw calls, and GL state calls the cache
+   found redundant are counted as avoided instead of issued */
+typedef struct
+{
+    int frame;
+    long long update_us;
+    long long render_us;    /* the render callback */
+    long long swap_us;      /* the final flush and the buffer swap, or
+                               drawing the command list and the swap */
+    int updates;
+    int draw_calls;
+    int vertices;
+    int state_changes;
+    int gl_calls;
+    int gl_calls_avoided;
+} ng_frame_stats;
+
 void ng_init_graphics(int width,
                       int height,
                       const char* title,
                       void (*update_func)(int),
                       void (*render_func)());
 
+/* call before ng_init_graphics; without it the NG_BACKEND environment
+   variable ("software" or "gl33") picks the backend, OpenGL 2.0 is the
+   default; the OpenGL 3.3 core profile falls back to it when the driver
+   doesn't have 3.3 */
+void ng_set_backend(int backend);
+/* the update callback runs at this fixed rate (default 60 Hz) and gets
+   the step in milliseconds; the process sleeps between steps */
+void ng_set_update_rate(int hz);
+/* monotonic clock in microseconds */
+long long ng_get_time_us();
+
+/* worker threads: 1 (default) does everything on the calling thread,
+   more make the software backend bin each frame into tiles drawn in
+   parallel and decimate plots in parallel, 0 uses every core; without
+   it NG_THREADS picks the count */
+void ng_set_threads(int threads);
+/* on the GL backends, runs the update and render callbacks on a thread
+   of their own: the ng_draw_* calls of a frame only fill a command list,
+   which the window's thread draws and swaps while the next frame is
+   updated and recorded. The callbacks must not call GL or GLUT
+   themselves. Call it before ng_init_graphics (without it
+   NG_RENDER_THREAD=1 turns it on); it is off while a trace is recorded
+   or replayed, and without a window */
+void ng_set_render_thread(int enabled);
+/* linked shader programs are kept in this directory and loaded instead
+   of compiled when the driver and the shaders are the same; the default
+   is $XDG_CACHE_HOME/noobgraphics or ~/.cache/noobgraphics (also
+   NG_PROGRAM_CACHE=<dir>), an empty string turns it off. Call it before
+   ng_init_graphics */
+void ng_set_program_cache(const char* dir);
+/* the GL backends render without a window or display, through Mesa's
+   surfaceless EGL into an offscreen framebuffer; libEGL is loaded at run
+   time, and the software backend is used when it can't be. Like the
+   software backend, ng_init_graphics then runs one update per frame
+   without waiting until the frame limit or ng_quit, and returns; there
+   are no input events. Call it before ng_init_graphics (without it
+   NG_HEADLESS=1 turns it on) */
+void ng_set_headless(int enabled);
+/* stops the headless loop after that many frames (also NG_FRAMES) */
+void ng_set_frame_limit(int frames);
+void ng_quit();
+
 void ng_force_redraw();
 
 void ng_set_color(unsigned int rgba_color);
 
+/* lines wider than 1 are drawn as quads, with the ends of
+   ng_set_line_cap */
 void ng_draw_line(int x0, int y0, int x1, int y1, int width);
+/* connected segments through count points in one batch, with mitered
+   joins (beveled at sharp turns) */
+void ng_draw_polyline(const ng_point* points, int count, int width);
+/* the ends of lines and polylines wider than 1: NG_CAP_BUTT (the
+   default) cuts them at the end points, NG_CAP_SQUARE reaches half the
+   width further and NG_CAP_ROUND puts a half disc there */
+void ng_set_line_cap(int cap);
+/* a size x size square centered on every point */
+void ng_draw_points(const ng_point* points, int count, int size);
+/* level of detail for plots with many points per pixel column, off by
+   default: ng_draw_polyline keeps the first, lowest, highest and last of
+   consecutive points in one column, and ng_draw_points merges the
+   squares they cover into one rectangle per run, so the picture stays
+   the same (overlapping translucent points are blended once) */
+void ng_set_decimation(int enabled);
 void ng_draw_rectangle(int x0, int y0, int x1, int y1);
 void ng_draw_text(int x, int y, const char* text);
+/* many rectangles or lines, each with its own color, in one call; with
+   instanced arrays the array is uploaded as is and expanded on the GPU,
+   otherwise it goes through the batch (the current color is kept) */
+void ng_draw_rectangles(const ng_rect* rects, int count);
+void ng_draw_lines(const ng_line* lines, int count, int width);
+
+/* images: width x height RGBA8 pixels, rows from the top, are copied
+   into atlas pages; a sub-image is a region of one, x and y from its top
+   left corner, sharing its pixels (frames of a sprite sheet) and is
+   freed separately */
+typedef struct ng_image ng_image;
+ng_image* ng_create_image(const unsigned char* rgba, int width, int height);
+ng_image* ng_create_sub_image(const ng_image* image, int x, int y,
+                              int width, int height);
+void ng_free_image(ng_image* image);
+void ng_get_image_size(const ng_image* image, int* width, int* height);
+/* starts reading a PPM (P6) or QOI file on a loader thread and returns
+   at once; the image draws nothing and has no size until it has been
+   decoded and put in a page, a few frames later. ng_image_ready is then
+   1, it is 0 while loading and -1 if the file couldn't be loaded */
+ng_image* ng_load_image(const char* path);
+int ng_image_ready(const ng_image* image);
+/* the image with its bottom left corner at x, y, or stretched from
+   x0, y0 to x1, y1, multiplied by the current color (0xFFFFFFFF draws
+   it unchanged) */
+void ng_draw_image(const ng_image* image, int x, int y);
+void ng_draw_image_scaled(const ng_image* image, int x0, int y0, int x1, int y1);
+
+/* one image stretched from x0, y0 to x1, y1 and multiplied by color */
+typedef struct
+{
+    const ng_image* image;
+    int x0, y0, x1, y1;
+    unsigned int color;
+} ng_sprite;
+
+/* many sprites in as few draws as possible: they are grouped by atlas
+   page, keeping their order within a page, so sprites on different
+   pages don't overlap in array order */
+void ng_draw_sprites(const ng_sprite* sprites, int count);
+
+/* retained geometry: the ng_draw_* calls between ng_begin_geometry and
+   ng_end_geometry are stored in a static vertex buffer instead of being
+   drawn, and ng_draw_geometry replays them without regenerating any
+   vertex; a geometry drawn while another is recorded is copied into
+   it */
+typedef struct ng_geometry ng_geometry;
+ng_geometry* ng_begin_geometry();
+/* while recording, the position of the next primitive; pass it to
+   ng_begin_geometry_update to redraw the primitives recorded from there
+   in place, with the same shapes but new coordinates or colors */
+int ng_geometry_mark();
+void ng_begin_geometry_update(ng_geometry* geometry, int mark);
+void ng_end_geometry();
+void ng_draw_geometry(const ng_geometry* geometry);
+void ng_free_geometry(ng_geometry* geometry);
+
+/* command lists: the ng_draw_* calls a thread makes between
+   ng_begin_command_list and ng_end_command_list are stored in the list,
+   so worker threads can record parts of a frame at the same time and
+   ng_draw_command_list draws them in the order it is called. Every
+   thread has a current color of its own. Images and geometries are only
+   read while lists are recorded, create, update and free them (and set
+   the decimation) in between. Traces don't keep what the lists
+   hold. */
+typedef struct ng_command_list ng_command_list;
+ng_command_list* ng_create_command_list();
+/* empties the list; the calling thread records into it */
+void ng_begin_command_list(ng_command_list* list);
+void ng_end_command_list();
+/* while recording, appends the list to the one being recorded */
+void ng_draw_command_list(const ng_command_list* list);
+void ng_free_command_list(ng_command_list* list);
+
+/* the profiler keeps the last 512 frames; frames_ago 0 is the latest,
+   returns 0 for frames it doesn't have */
+int ng_get_frame_stats(int frames_ago, ng_frame_stats* stats);
+/* writes the kept frames as CSV, NG_PROFILE_CSV=<path> does it at exit */
+int ng_write_profile_csv(const char* path);
+/* graph of the frame times in the bottom left corner (also NG_PROFILE=1) */
+void ng_set_profiler_overlay(int enabled);
+
+/* records the session into a binary trace: the window size, the frames
+   and every ng_set_color, ng_draw_*, image and geometry call in them
+   (also NG_TRACE=<path>); input and update steps aren't kept, the calls
+   they led to are. Call it before ng_init_graphics, the file is
+   complete at exit */
+int ng_record_trace(const char* path);
+/* opens a window of the recorded size and issues the recorded calls
+   again, one recorded frame per frame without waiting, then returns
+   (with freeglut; other GLUTs can only exit); NG_PROFILE_CSV keeps the
+   frame times to compare backends and builds. Returns 0 if the file
+   isn't a trace */
+int ng_replay_trace(const char* path);
+
+/* frame capture: frames are read back without waiting for the GPU and
+   saved or passed on by a capture thread a frame or two later.
+   ng_capture_frame saves the frame being drawn (the next one outside
+   the render callback) as a binary PPM; it returns at once and the
+   file is complete at the latest at exit. */
+int ng_capture_frame(const char* path);
+/* called on the capture thread with every frame drawn from now on, RGBA
+   rows from the top, frame counting the frames drawn; NULL stops it.
+   When it falls 8 frames behind, frames are left out, except without a
+   window, where the drawing waits for it */
+typedef void (*ng_capture_func)(const unsigned char* rgba, int width,
+                                int height, int frame, void* ctx);
+void ng_set_capture_callback(ng_capture_func func, void* ctx);
+/* streams the frames drawn from now on to fd as YUV4MPEG2 (4:2:0 at
+   the update rate, the size of the first frame) for an encoder reading
+   a pipe, e.g. ffmpeg -i pipe.y4m out.mp4; the frames are converted on
+   the capture thread. The stream has a frame for every update step: a
+   frame drawn after several steps, or one the capture thread fell
+   behind on, is made up by sending the frame before again, and a
+   redraw without a step is left out. -1 stops the stream, waiting for
+   the frame being written, and fd is never closed; every call starts a
+   stream with a header of its own, also on a reused descriptor.
+   NG_Y4M=<path> streams to a file or named pipe */
+int ng_stream_y4m(int fd);
+/* frames the callback or the stream missed because it was behind */
+int ng_get_dropped_frames();
 
+/* takes the oldest queued input event, returns 0 when there is none;
+   once a program polls, ng_get_mouse/ng_get_keyboard follow the events
+   it has taken, otherwise they are fed one keystroke per update */
+int ng_poll_event(ng_event* event);
+/* events lost because the queue was full */
+int ng_get_dropped_events();
 void ng_get_mouse(int* x, int* y, int* button, int* state);
 void ng_get_keyboard(unsigned char* key, int* state);
 int ng_get_window_size(int* width, int* height);
+/* RGBA pixels of the software backend or of the last headless GL
+   frame, top row first */
+const unsigned char* ng_get_framebuffer(int* width, int* height);
 
 #endif
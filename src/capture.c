@@ -0,0 +1,559 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+
+/* frames are read back at the end of the frame into a ring of pixel
+   buffers on GL and mapped a frame or two later, once their fence says
+   the copy is done, so the read never waits for the GPU; only the
+   oldest buffer is mapped regardless when the ring comes round again.
+   The pixels are then copied out and a capture thread writes the files
+   or calls the callback, and converts the frames of a Y4M stream. A
+   callback or a stream that falls NG_CAPTURE_QUEUE frames behind loses
+   frames instead of slowing the drawing down, except without a window,
+   where nothing paces the frames and the drawing waits for it. A stream
+   has a frame for every update step, as its header says: a frame drawn
+   after several steps, or after frames it lost, repeats the frame
+   before for the steps in between, and a redraw without a step is left
+   out. */
+#define NG_CAPTURE_BUFFERS 3
+#define NG_CAPTURE_QUEUE 8
+
+struct ng_capture_job
+{
+    char* path;             // NULL for the callback and the stream
+    ng_capture_func func;   // NULL for the stream
+    void* ctx;
+    int fd;                 // the stream
+    int generation;         // the ng_stream_y4m call it belongs to
+    int repeats;            // stream frames to repeat before this one
+    unsigned char* pixels;
+    int width;
+    int height;
+    int frame;
+    int bottom_up;          // rows as glReadPixels returns them
+    struct ng_capture_job* next;
+};
+
+typedef struct
+{
+    ng_capture_job* head;
+    ng_capture_job* tail;
+} ng_capture_queue;
+
+typedef struct
+{
+    GLuint buffer;
+    GLsizeiptr size;
+    GLsync fence;
+    ng_capture_job* jobs;   // NULL while the buffer is free
+    int width;
+    int height;
+} ng_capture_slot;
+
+static ng_capture_job* ng_capture_take(int frame, int width, int height,
+                                       int wait);
+static ng_capture_job* ng_capture_add(ng_capture_job** jobs, int wait);
+static void ng_capture_retire(ng_capture_slot* slot);
+static void ng_capture_finish(ng_capture_job* jobs, const unsigned char* pixels,
+                              int bottom_up);
+static int ng_capture_start();
+static void* ng_capture_main(void* arg);
+static void ng_capture_run(ng_capture_job* job);
+static int ng_capture_write_ppm(const ng_capture_job* job);
+static void ng_capture_push(ng_capture_queue* queue, ng_capture_job* job);
+static ng_capture_job* ng_capture_pop(ng_capture_queue* queue);
+
+/* the mutex guards the requests, the callback, the stream, the queue
+   and the counts; the slots belong to the thread with the context */
+static pthread_mutex_t ng_capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ng_capture_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t ng_capture_thread;
+static int ng_capture_running;
+static int ng_capture_stop;
+static ng_capture_queue ng_capture_requests;
+static ng_capture_queue ng_capture_held;   // the logic thread's frame
+static ng_capture_queue ng_capture_jobs;
+static ng_capture_func ng_capture_callback;
+static void* ng_capture_ctx;
+static int ng_capture_pending;          // callback and stream frames not done
+static int ng_capture_dropped;
+static pthread_cond_t ng_capture_done = PTHREAD_COND_INITIALIZER;
+static int ng_capture_stream = -1;
+static int ng_capture_generation;       // counts the ng_stream_y4m calls
+static int ng_capture_steps;            // update steps since the last sent
+static int ng_capture_streaming;        // a stream frame has been sent
+static int ng_capture_writing;          // the generation being written, or 0
+static ng_capture_slot ng_capture_slots[NG_CAPTURE_BUFFERS];
+static int ng_capture_next;
+static int ng_capture_frames;
+
+int ng_capture_frame(const char* path)
+{
+    if (path == NULL)
+        return 0;
+
+    ng_capture_job* job = calloc(1, sizeof(ng_capture_job));
+    char* copy = malloc(strlen(path) + 1);
+    if (job == NULL || copy == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        free(job);
+        free(copy);
+        return 0;
+    }
+    strcpy(copy, path);
+    job->path = copy;
+
+    // with a render thread the frame goes with its command list
+    pthread_mutex_lock(&ng_capture_mutex);
+    ng_capture_push(ng_commands_on_logic_thread() ? &ng_capture_held
+                                                  : &ng_capture_requests,
+                    job);
+    pthread_mutex_unlock(&ng_capture_mutex);
+    return 1;
+}
+
+// the requests of the frame the logic thread has recorded
+ng_capture_job* ng_capture_hold()
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    ng_capture_job* jobs = ng_capture_held.head;
+    ng_capture_held.head = ng_capture_held.tail = NULL;
+    pthread_mutex_unlock(&ng_capture_mutex);
+    return jobs;
+}
+
+// the list is drawn, or dropped, so its requests are for this frame
+void ng_capture_release(ng_capture_job* jobs)
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    while (jobs != NULL)
+    {
+        ng_capture_job* job = jobs;
+        jobs = job->next;
+        ng_capture_push(&ng_capture_requests, job);
+    }
+    pthread_mutex_unlock(&ng_capture_mutex);
+}
+
+void ng_set_capture_callback(ng_capture_func func, void* ctx)
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    ng_capture_callback = func;
+    ng_capture_ctx = ctx;
+    pthread_mutex_unlock(&ng_capture_mutex);
+}
+
+// every call starts a new stream, even on a descriptor with the number
+// of the last one; frames queued for the one before are left out, and
+// one being written is finished before this returns, so fd can be closed
+int ng_stream_y4m(int fd)
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    ng_capture_stream = fd >= 0 ? fd : -1;
+    ++ng_capture_generation;
+    ng_capture_steps = 0;
+    ng_capture_streaming = 0;
+    while (ng_capture_writing != 0)
+        pthread_cond_wait(&ng_capture_done, &ng_capture_mutex);
+    pthread_mutex_unlock(&ng_capture_mutex);
+    return fd >= 0;
+}
+
+// on the logic thread after every update step
+void ng_capture_step()
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    ++ng_capture_steps;
+    pthread_mutex_unlock(&ng_capture_mutex);
+}
+
+int ng_get_dropped_frames()
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    int dropped = ng_capture_dropped;
+    pthread_mutex_unlock(&ng_capture_mutex);
+    return dropped;
+}
+
+// at the end of a frame on the thread with the context, after the
+// software backend has presented and before a GL swap; wait when the
+// frames aren't paced by a window
+void ng_capture_read(int wait)
+{
+    int width, height, i;
+    int frame = ng_capture_frames++;
+
+    if (ng_backend == NG_BACKEND_SOFTWARE)
+    {
+        const unsigned char* pixels = ng_soft_get_pixels(&width, &height);
+        ng_capture_job* jobs = ng_capture_take(frame, width, height, wait);
+        if (jobs != NULL)
+            ng_capture_finish(jobs, pixels, 0);
+        return;
+    }
+
+    // the finished copies go out oldest first, so frames stay in order;
+    // without fences a copy is taken to be done a frame later
+    for (i = 0; i < NG_CAPTURE_BUFFERS; ++i)
+    {
+        ng_capture_slot* slot =
+            &ng_capture_slots[(ng_capture_next + i) % NG_CAPTURE_BUFFERS];
+        if (slot->jobs == NULL)
+            continue;
+        if (i > 0 && slot->fence != NULL &&
+            glClientWaitSync(slot->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+        ng_capture_retire(slot);
+    }
+
+    ng_get_window_size(&width, &height);
+    ng_capture_job* jobs = ng_capture_take(frame, width, height, wait);
+    if (jobs == NULL)
+        return;
+
+    // without pixel buffers the read has to wait
+    if (ng_backend != NG_BACKEND_GL33 && !GLEW_VERSION_2_1 &&
+        !GLEW_ARB_pixel_buffer_object)
+    {
+        unsigned char* pixels = malloc((size_t)width * height * 4);
+        if (pixels == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            ng_capture_finish(jobs, NULL, 1);
+            return;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        ng_capture_finish(jobs, pixels, 1);
+        free(pixels);
+        return;
+    }
+
+    ng_capture_slot* slot = &ng_capture_slots[ng_capture_next];
+    ng_capture_next = (ng_capture_next + 1) % NG_CAPTURE_BUFFERS;
+    GLsizeiptr size = (GLsizeiptr)width * height * 4;
+    if (slot->buffer == 0)
+        glGenBuffers(1, &slot->buffer);
+    ng_gl_bind_buffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    if (slot->size != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot->size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    ng_gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (GLEW_VERSION_3_2 || GLEW_ARB_sync)
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->jobs = jobs;
+    slot->width = width;
+    slot->height = height;
+}
+
+// copies still in the buffers are mapped, then the capture thread
+// finishes every job it has; from the logic thread only the thread is
+// stopped
+void ng_capture_free()
+{
+    int i;
+    for (i = 0; i < NG_CAPTURE_BUFFERS && !ng_commands_recording(); ++i)
+    {
+        ng_capture_slot* slot =
+            &ng_capture_slots[(ng_capture_next + i) % NG_CAPTURE_BUFFERS];
+        if (slot->jobs != NULL)
+            ng_capture_retire(slot);
+        if (slot->buffer != 0)
+            ng_gl_delete_buffer(slot->buffer);
+        slot->buffer = 0;
+        slot->size = 0;
+    }
+
+    pthread_mutex_lock(&ng_capture_mutex);
+    int running = ng_capture_running;
+    ng_capture_stop = 1;
+    pthread_cond_signal(&ng_capture_wake);
+    pthread_mutex_unlock(&ng_capture_mutex);
+    if (running)
+        pthread_join(ng_capture_thread, NULL);
+    ng_capture_running = 0;
+
+    ng_capture_job* job;
+    ng_capture_release(ng_capture_hold());
+    while ((job = ng_capture_pop(&ng_capture_requests)) != NULL)
+    {
+        free(job->path);
+        free(job);
+    }
+}
+
+// the requests made for this frame, and a job for the callback and the
+// stream unless they are too far behind; NULL when there is nothing to
+// capture
+ng_capture_job* ng_capture_take(int frame, int width, int height, int wait)
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    ng_capture_job* jobs = ng_capture_requests.head;
+    ng_capture_requests.head = ng_capture_requests.tail = NULL;
+    if (ng_capture_callback != NULL)
+    {
+        ng_capture_job* job = ng_capture_add(&jobs, wait);
+        if (job != NULL)
+        {
+            job->func = ng_capture_callback;
+            job->ctx = ng_capture_ctx;
+        }
+    }
+    if (ng_capture_stream >= 0 &&
+        (ng_capture_steps > 0 || !ng_capture_streaming))
+    {
+        // the steps stay owed while frames are dropped
+        ng_capture_job* job = ng_capture_add(&jobs, wait);
+        if (job != NULL)
+        {
+            job->fd = ng_capture_stream;
+            job->generation = ng_capture_generation;
+            job->repeats = ng_capture_steps > 1 ? ng_capture_steps - 1 : 0;
+            ng_capture_steps = 0;
+            ng_capture_streaming = 1;
+        }
+    }
+    pthread_mutex_unlock(&ng_capture_mutex);
+
+    ng_capture_job* job;
+    for (job = jobs; job != NULL; job = job->next)
+    {
+        job->frame = frame;
+        job->width = width;
+        job->height = height;
+    }
+    return jobs;
+}
+
+// with the mutex held; a job in front of jobs, or NULL and a dropped
+// frame when the capture thread is too far behind and wait is 0
+ng_capture_job* ng_capture_add(ng_capture_job** jobs, int wait)
+{
+    ng_capture_job* job = NULL;
+    while (wait && ng_capture_pending >= NG_CAPTURE_QUEUE)
+        pthread_cond_wait(&ng_capture_done, &ng_capture_mutex);
+    if (ng_capture_pending < NG_CAPTURE_QUEUE)
+        job = calloc(1, sizeof(ng_capture_job));
+    if (job == NULL)
+    {
+        ++ng_capture_dropped;
+        return NULL;
+    }
+    job->next = *jobs;
+    *jobs = job;
+    ++ng_capture_pending;
+    return job;
+}
+
+void ng_capture_retire(ng_capture_slot* slot)
+{
+    ng_gl_bind_buffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    const unsigned char* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER,
+                                              GL_READ_ONLY);
+    ng_capture_finish(slot->jobs, pixels, 1);
+    if (pixels != NULL)
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    ng_gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (slot->fence != NULL)
+        glDeleteSync(slot->fence);
+    slot->fence = NULL;
+    slot->jobs = NULL;
+}
+
+// every job gets its own copy of the pixels and goes to the capture
+// thread; without pixels the jobs are dropped
+void ng_capture_finish(ng_capture_job* jobs, const unsigned char* pixels,
+                       int bottom_up)
+{
+    pthread_mutex_lock(&ng_capture_mutex);
+    int started = ng_capture_start();
+    while (jobs != NULL)
+    {
+        ng_capture_job* job = jobs;
+        jobs = job->next;
+        size_t bytes = (size_t)job->width * job->height * 4;
+        job->pixels = started && pixels != NULL ? malloc(bytes) : NULL;
+        if (job->pixels == NULL)
+        {
+            if (pixels != NULL)
+                fprintf(stderr, "frame %d isn't captured\n", job->frame);
+            if (job->path == NULL)
+                --ng_capture_pending;
+            free(job->path);
+            free(job);
+            continue;
+        }
+        memcpy(job->pixels, pixels, bytes);
+        job->bottom_up = bottom_up;
+        ng_capture_push(&ng_capture_jobs, job);
+    }
+    pthread_cond_signal(&ng_capture_wake);
+    pthread_mutex_unlock(&ng_capture_mutex);
+}
+
+// with the mutex held; the thread starts with the first frame
+int ng_capture_start()
+{
+    if (ng_capture_running)
+        return 1;
+    ng_capture_stop = 0;
+    if (pthread_create(&ng_capture_thread, NULL, ng_capture_main, NULL) != 0)
+    {
+        fprintf(stderr, "pthread_create failed\n");
+        return 0;
+    }
+    ng_capture_running = 1;
+    return 1;
+}
+
+// the queue is emptied before the thread stops; an encoder closing the
+// stream's pipe makes the write fail instead of killing the program
+void* ng_capture_main(void* arg)
+{
+    sigset_t signals;
+    (void)arg;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    pthread_mutex_lock(&ng_capture_mutex);
+    for (;;)
+    {
+        ng_capture_job* job = ng_capture_pop(&ng_capture_jobs);
+        if (job == NULL)
+        {
+            if (ng_capture_stop)
+                break;
+            pthread_cond_wait(&ng_capture_wake, &ng_capture_mutex);
+            continue;
+        }
+        int pending = job->path == NULL;
+        int stream = pending && job->func == NULL;
+        if (stream && job->generation != ng_capture_generation)
+            job->fd = -1;
+        if (stream && job->fd >= 0)
+            ng_capture_writing = job->generation;
+        pthread_mutex_unlock(&ng_capture_mutex);
+
+        if (!stream || job->fd >= 0)
+            ng_capture_run(job);
+        free(job->pixels);
+        free(job->path);
+        free(job);
+
+        pthread_mutex_lock(&ng_capture_mutex);
+        if (pending)
+            --ng_capture_pending;
+        if (stream)
+            ng_capture_writing = 0;
+        pthread_cond_broadcast(&ng_capture_done);
+    }
+    pthread_mutex_unlock(&ng_capture_mutex);
+    ng_y4m_free();
+    return NULL;
+}
+
+// the callback gets the rows top first, the stream takes them either way
+void ng_capture_run(ng_capture_job* job)
+{
+    int y;
+    if (job->path != NULL)
+    {
+        if (!ng_capture_write_ppm(job))
+            fprintf(stderr, "can't write %s\n", job->path);
+        return;
+    }
+    if (job->func == NULL)
+    {
+        if (!ng_y4m_write(job->fd, job->generation, job->pixels, job->width,
+                          job->height, job->bottom_up, job->repeats))
+        {
+            pthread_mutex_lock(&ng_capture_mutex);
+            if (ng_capture_generation == job->generation)
+                ng_capture_stream = -1;
+            pthread_mutex_unlock(&ng_capture_mutex);
+        }
+        return;
+    }
+
+    size_t row = (size_t)job->width * 4;
+    unsigned char* top = job->pixels;
+    unsigned char* bottom = job->pixels + row * (job->height - 1);
+    unsigned char* swap = job->bottom_up ? malloc(row) : NULL;
+    if (job->bottom_up && swap == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return;
+    }
+    for (y = 0; job->bottom_up && y < job->height / 2; ++y)
+    {
+        memcpy(swap, top, row);
+        memcpy(top, bottom, row);
+        memcpy(bottom, swap, row);
+        top += row;
+        bottom -= row;
+    }
+    free(swap);
+    job->func(job->pixels, job->width, job->height, job->frame, job->ctx);
+}
+
+int ng_capture_write_ppm(const ng_capture_job* job)
+{
+    int x, y;
+    FILE* file = fopen(job->path, "wb");
+    unsigned char* rgb = malloc((size_t)job->width * 3);
+    if (file == NULL || rgb == NULL)
+    {
+        if (file != NULL)
+            fclose(file);
+        free(rgb);
+        return 0;
+    }
+
+    int ok = fprintf(file, "P6\n%d %d\n255\n", job->width, job->height) > 0;
+    for (y = 0; ok && y < job->height; ++y)
+    {
+        int source = job->bottom_up ? job->height - 1 - y : y;
+        const unsigned char* p = job->pixels + (size_t)source * job->width * 4;
+        for (x = 0; x < job->width; ++x)
+        {
+            rgb[x * 3] = p[x * 4];
+            rgb[x * 3 + 1] = p[x * 4 + 1];
+            rgb[x * 3 + 2] = p[x * 4 + 2];
+        }
+        ok = fwrite(rgb, 3, job->width, file) == (size_t)job->width;
+    }
+    free(rgb);
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+void ng_capture_push(ng_capture_queue* queue, ng_capture_job* job)
+{
+    job->next = NULL;
+    if (queue->tail != NULL)
+        queue->tail->next = job;
+    else
+        queue->head = job;
+    queue->tail = job;
+}
+
+ng_capture_job* ng_capture_pop(ng_capture_queue* queue)
+{
+    ng_capture_job* job = queue->head;
+    if (job != NULL)
+    {
+        queue->head = job->next;
+        if (queue->head == NULL)
+            queue->tail = NULL;
+    }
+    return job;
+}
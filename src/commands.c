@@ -0,0 +1,450 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/* a command list holds the vertices of a run of draws and one command
+   per run of them with the same primitive, page and line width. Every
+   thread can record one: its draws reserve their vertices in the list
+   instead of the batch, and drawing a list appends it to the list the
+   thread records, or submits it.
+
+   With a render thread the application's callbacks run on a logic
+   thread, which records the frame into one of two lists; the GLUT
+   thread keeps the context and draws the list finished last while the
+   next one is written, so the updates don't wait for the swap. A list
+   stays with the render thread until a newer one is finished, and is
+   drawn again when the window needs a repaint. */
+#define NG_COMMAND_LISTS 2
+/* how long the render thread waits for a list before GLUT handles the
+   events again */
+#define NG_COMMANDS_WAIT_US 4000
+
+typedef struct
+{
+    GLenum mode;
+    GLfloat line_width;
+    int page;
+    int first;
+    int count;
+    int paused;             // drawn by the profiler overlay
+} ng_command;
+
+struct ng_command_list
+{
+    ng_vertex* vertices;
+    int size;
+    int capacity;
+    ng_command* commands;
+    int commands_size;
+    int commands_capacity;
+    long long render_us;
+    ng_capture_job* captures;   // frames asked for while it was recorded
+};
+
+static void* ng_commands_main(void* arg);
+static ng_command_list* ng_commands_target();
+static ng_command_list* ng_commands_acquire();
+static ng_vertex* ng_commands_add(ng_command_list* list, GLenum mode,
+                                  int count, GLfloat line_width, int page,
+                                  int paused);
+static void ng_commands_submit(const ng_command_list* list);
+static void ng_commands_present(ng_command_list* list);
+static void ng_commands_make_key();
+static void ng_commands_thread_exit(void* value);
+
+/* the list the calling thread records, and the key that frees the
+   thread's scratch buffers when it exits */
+static _Thread_local ng_command_list* ng_commands_recorded;
+static pthread_once_t ng_commands_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ng_commands_key;
+
+/* the logic thread writes ng_list_writing, ng_list_ready is finished
+   and not taken yet and the render thread has ng_list_shown; the mutex
+   guards all but the first */
+static ng_command_list ng_lists[NG_COMMAND_LISTS];
+static int ng_list_writing = -1;
+static int ng_list_ready = -1;
+static int ng_list_shown = -1;
+static _Thread_local int ng_commands_logic_thread;
+static void (*ng_commands_logic)();
+static int ng_commands_running;
+static int ng_commands_stop;
+static int ng_commands_done;
+static pthread_t ng_commands_thread;
+static pthread_mutex_t ng_commands_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ng_commands_changed;
+static GLuint ng_commands_vbo;
+static GLuint ng_commands_vao;
+
+ng_command_list* ng_create_command_list()
+{
+    ng_command_list* list = calloc(1, sizeof(ng_command_list));
+    if (list == NULL)
+        fprintf(stderr, "out of memory\n");
+    return list;
+}
+
+void ng_begin_command_list(ng_command_list* list)
+{
+    if (list == NULL)
+        return;
+    if (ng_commands_recorded != NULL)
+    {
+        fprintf(stderr, "ng_begin_command_list: already recording\n");
+        return;
+    }
+
+    pthread_once(&ng_commands_once, ng_commands_make_key);
+    pthread_setspecific(ng_commands_key, list);
+    list->size = 0;
+    list->commands_size = 0;
+    ng_commands_recorded = list;
+}
+
+void ng_end_command_list()
+{
+    ng_commands_recorded = NULL;
+}
+
+// the commands keep their state, so the draws stay separate from the
+// ones around them
+void ng_draw_command_list(const ng_command_list* list)
+{
+    int i;
+    if (list == NULL || list == ng_commands_recorded)
+        return;
+
+    if (!ng_commands_recording() && !ng_geometry_recording())
+    {
+        ng_batch_flush();
+        ng_commands_submit(list);
+        return;
+    }
+
+    // into the list or geometry being recorded
+    for (i = 0; i < list->commands_size; ++i)
+    {
+        const ng_command* c = &list->commands[i];
+        ng_vertex* v = ng_batch_reserve(c->mode, c->count, c->line_width,
+                                        c->page);
+        if (v == NULL)
+            return;
+        memcpy(v, list->vertices + c->first, c->count * sizeof(ng_vertex));
+    }
+}
+
+void ng_free_command_list(ng_command_list* list)
+{
+    if (list == NULL)
+        return;
+    if (list == ng_commands_recorded)
+        ng_commands_recorded = NULL;
+    free(list->vertices);
+    free(list->commands);
+    free(list);
+}
+
+// logic runs on the new thread until it returns
+int ng_commands_start(void (*logic)())
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ng_commands_changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    ng_commands_logic = logic;
+    ng_commands_stop = 0;
+    ng_commands_done = 0;
+    if (pthread_create(&ng_commands_thread, NULL, ng_commands_main, NULL) != 0)
+    {
+        fprintf(stderr, "pthread_create failed, rendering without a render thread\n");
+        return 0;
+    }
+    ng_commands_running = 1;
+    return 1;
+}
+
+// stops the logic thread after its current step; from the logic thread
+// itself (exit in a callback) nothing can be freed
+void ng_commands_free()
+{
+    int i;
+    if (ng_commands_logic_thread)
+        return;
+
+    if (ng_commands_running)
+    {
+        pthread_mutex_lock(&ng_commands_mutex);
+        ng_commands_stop = 1;
+        pthread_cond_broadcast(&ng_commands_changed);
+        pthread_mutex_unlock(&ng_commands_mutex);
+        pthread_join(ng_commands_thread, NULL);
+        ng_commands_running = 0;
+
+        for (i = 0; i < NG_COMMAND_LISTS; ++i)
+        {
+            ng_capture_release(ng_lists[i].captures);
+            free(ng_lists[i].vertices);
+            free(ng_lists[i].commands);
+            memset(&ng_lists[i], 0, sizeof(ng_command_list));
+        }
+        ng_list_writing = ng_list_ready = ng_list_shown = -1;
+    }
+
+    if (ng_commands_vao != 0)
+        ng_gl_delete_vertex_array(ng_commands_vao);
+    if (ng_commands_vbo != 0)
+        ng_gl_delete_buffer(ng_commands_vbo);
+    ng_commands_vao = ng_commands_vbo = 0;
+}
+
+int ng_commands_on_logic_thread()
+{
+    return ng_commands_logic_thread;
+}
+
+int ng_commands_recording()
+{
+    return ng_commands_recorded != NULL || ng_commands_logic_thread;
+}
+
+int ng_commands_stopping()
+{
+    pthread_mutex_lock(&ng_commands_mutex);
+    int stop = ng_commands_stop;
+    pthread_mutex_unlock(&ng_commands_mutex);
+    return stop;
+}
+
+// solid primitives stay on the page of the command before them
+ng_vertex* ng_commands_reserve(GLenum mode, int vertices, GLfloat line_width,
+                               int page)
+{
+    ng_command_list* list = ng_commands_target();
+    if (list == NULL)
+        return NULL;
+
+    if (page == NG_ANY_PAGE)
+        page = list->commands_size > 0
+            ? list->commands[list->commands_size - 1].page : 0;
+    return ng_commands_add(list, mode, vertices, line_width, page,
+                           ng_profile_is_paused());
+}
+
+void ng_commands_draw(const ng_vertex* vertices, GLenum mode, int count,
+                      GLfloat line_width, int page)
+{
+    ng_command_list* list = ng_commands_target();
+    if (list == NULL)
+        return;
+
+    ng_vertex* v = ng_commands_add(list, mode, count, line_width, page,
+                                   ng_profile_is_paused());
+    if (v != NULL)
+        memcpy(v, vertices, count * sizeof(ng_vertex));
+}
+
+// hands the frame to the render thread
+void ng_commands_publish(long long render_us)
+{
+    ng_command_list* list = ng_commands_acquire();
+    if (list == NULL)
+        return;
+
+    list->render_us = render_us;
+    list->captures = ng_capture_hold();
+    pthread_mutex_lock(&ng_commands_mutex);
+    ng_list_ready = ng_list_writing;
+    pthread_cond_broadcast(&ng_commands_changed);
+    pthread_mutex_unlock(&ng_commands_mutex);
+    ng_list_writing = -1;
+}
+
+// the GLUT idle function: draws the newest list if one comes in time,
+// and quits once the logic thread has returned
+void ng_commands_idle()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += NG_COMMANDS_WAIT_US * 1000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_nsec -= 1000000000L;
+        ++ts.tv_sec;
+    }
+
+    pthread_mutex_lock(&ng_commands_mutex);
+    while (ng_list_ready < 0 && !ng_commands_done)
+    {
+        if (pthread_cond_timedwait(&ng_commands_changed, &ng_commands_mutex,
+                                   &ts) == ETIMEDOUT)
+            break;
+    }
+    int ready = ng_list_ready;
+    int done = ng_commands_done;
+    if (ready >= 0)
+    {
+        ng_list_shown = ready;
+        ng_list_ready = -1;
+        pthread_cond_broadcast(&ng_commands_changed);
+    }
+    pthread_mutex_unlock(&ng_commands_mutex);
+
+    if (ready >= 0)
+        ng_commands_present(&ng_lists[ready]);
+    else if (done)
+        exit(EXIT_SUCCESS);
+}
+
+// the GLUT display function repaints with the list shown last
+void ng_commands_display()
+{
+    static ng_command_list empty;
+    ng_commands_present(ng_list_shown >= 0 ? &ng_lists[ng_list_shown] : &empty);
+}
+
+void* ng_commands_main(void* arg)
+{
+    (void)arg;
+    ng_commands_logic_thread = 1;
+    ng_commands_logic();
+
+    pthread_mutex_lock(&ng_commands_mutex);
+    ng_commands_done = 1;
+    pthread_cond_broadcast(&ng_commands_changed);
+    pthread_mutex_unlock(&ng_commands_mutex);
+    return NULL;
+}
+
+// the application's list, or the frame on the logic thread
+ng_command_list* ng_commands_target()
+{
+    return ng_commands_recorded != NULL ? ng_commands_recorded
+                                        : ng_commands_acquire();
+}
+
+// a list that is neither finished nor shown, waiting for the render
+// thread to take the finished one; NULL once the thread is stopping
+ng_command_list* ng_commands_acquire()
+{
+    if (ng_list_writing >= 0)
+        return &ng_lists[ng_list_writing];
+
+    int i = NG_COMMAND_LISTS;
+    pthread_mutex_lock(&ng_commands_mutex);
+    while (!ng_commands_stop)
+    {
+        for (i = 0; i < NG_COMMAND_LISTS; ++i)
+        {
+            if (i != ng_list_ready && i != ng_list_shown)
+                break;
+        }
+        if (i < NG_COMMAND_LISTS)
+            break;
+        pthread_cond_wait(&ng_commands_changed, &ng_commands_mutex);
+    }
+    pthread_mutex_unlock(&ng_commands_mutex);
+    if (i == NG_COMMAND_LISTS)
+        return NULL;
+
+    // a list replaced before it was drawn passes its requests on
+    ng_list_writing = i;
+    ng_capture_release(ng_lists[i].captures);
+    ng_lists[i].captures = NULL;
+    ng_lists[i].size = 0;
+    ng_lists[i].commands_size = 0;
+    return &ng_lists[i];
+}
+
+// count vertices at the end of the list; consecutive draws with the
+// same state become one command
+ng_vertex* ng_commands_add(ng_command_list* list, GLenum mode, int count,
+                           GLfloat line_width, int page, int paused)
+{
+    ng_vertex* v = ng_grow(list->vertices, &list->capacity,
+                           list->size + count, sizeof(ng_vertex));
+    if (v == NULL)
+        return NULL;
+    list->vertices = v;
+
+    ng_command* c = list->commands_size > 0
+        ? &list->commands[list->commands_size - 1] : NULL;
+    if (c == NULL || c->mode != mode || c->page != page ||
+        c->line_width != line_width || c->paused != paused)
+    {
+        c = ng_grow(list->commands, &list->commands_capacity,
+                    list->commands_size + 1, sizeof(ng_command));
+        if (c == NULL)
+            return NULL;
+        list->commands = c;
+        c = &list->commands[list->commands_size++];
+        c->mode = mode;
+        c->line_width = line_width;
+        c->page = page;
+        c->first = list->size;
+        c->count = 0;
+        c->paused = paused;
+    }
+
+    v = list->vertices + list->size;
+    list->size += count;
+    c->count += count;
+    return v;
+}
+
+// all the vertices go into the buffer at once, the commands draw ranges
+void ng_commands_submit(const ng_command_list* list)
+{
+    int paused = ng_profile_is_paused();
+    int i;
+
+    if (ng_backend != NG_BACKEND_SOFTWARE && list->size > 0)
+    {
+        GLsizeiptr bytes = list->size * sizeof(ng_vertex);
+        if (ng_commands_vbo == 0)
+            glGenBuffers(1, &ng_commands_vbo);
+        ng_gl_bind_buffer(GL_ARRAY_BUFFER, ng_commands_vbo);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, list->vertices);
+    }
+
+    for (i = 0; i < list->commands_size; ++i)
+    {
+        const ng_command* c = &list->commands[i];
+        ng_profile_set_paused(paused || c->paused);
+        ng_draw_vertices(ng_commands_vbo, &ng_commands_vao, list->vertices,
+                         c->mode, c->first, c->count, c->line_width, c->page);
+    }
+    ng_profile_set_paused(paused);
+}
+
+void ng_commands_present(ng_command_list* list)
+{
+    long long start = ng_get_time_us();
+    ng_gl_scissor(0, 0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    ng_commands_submit(list);
+    ng_capture_release(list->captures);
+    list->captures = NULL;
+    ng_capture_read(0);
+    glutSwapBuffers();
+    ng_profile_end_frame(list->render_us, ng_get_time_us() - start);
+}
+
+void ng_commands_make_key()
+{
+    pthread_key_create(&ng_commands_key, ng_commands_thread_exit);
+}
+
+// runs on a thread that has recorded a list when it exits
+void ng_commands_thread_exit(void* value)
+{
+    (void)value;
+    ng_plot_free();
+    ng_sprites_free_scratch();
+}
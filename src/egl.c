@@ -0,0 +1,252 @@
+#include "internal.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+/* the GL backends without a window: Mesa's surfaceless platform gives a
+   context with no surface at all, and the frames are drawn into a
+   framebuffer object of the window's size instead. libEGL is opened at
+   run time, so programs with a window don't need it. */
+
+static int ng_egl_load();
+static void* ng_egl_symbol(const char* name);
+static EGLContext ng_egl_create_context(EGLConfig config, int core);
+
+static struct
+{
+    void* library;
+    PFNEGLQUERYSTRINGPROC query_string;
+    PFNEGLGETPROCADDRESSPROC get_proc_address;
+    PFNEGLINITIALIZEPROC initialize;
+    PFNEGLBINDAPIPROC bind_api;
+    PFNEGLCHOOSECONFIGPROC choose_config;
+    PFNEGLCREATECONTEXTPROC create_context;
+    PFNEGLMAKECURRENTPROC make_current;
+    PFNEGLGETERRORPROC get_error;
+    PFNEGLDESTROYCONTEXTPROC destroy_context;
+    PFNEGLTERMINATEPROC terminate;
+} ng_egl;
+
+static EGLDisplay ng_egl_display = EGL_NO_DISPLAY;
+static EGLContext ng_egl_context = EGL_NO_CONTEXT;
+static GLuint ng_egl_framebuffer;
+static GLuint ng_egl_renderbuffer;
+static int ng_egl_width;
+static int ng_egl_height;
+static unsigned char* ng_egl_pixels;
+
+int ng_egl_init(int width, int height)
+{
+    if (!ng_egl_load())
+        return 0;
+
+    const char* extensions = ng_egl.query_string(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)ng_egl.get_proc_address(
+            "eglGetPlatformDisplayEXT");
+    if (extensions == NULL || get_platform_display == NULL ||
+        strstr(extensions, "EGL_MESA_platform_surfaceless") == NULL)
+    {
+        fprintf(stderr, "EGL has no surfaceless platform\n");
+        return 0;
+    }
+
+    EGLint major, minor;
+    ng_egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                          EGL_DEFAULT_DISPLAY, NULL);
+    if (ng_egl_display == EGL_NO_DISPLAY ||
+        !ng_egl.initialize(ng_egl_display, &major, &minor))
+    {
+        fprintf(stderr, "eglInitialize failed: 0x%x\n", ng_egl.get_error());
+        ng_egl_display = EGL_NO_DISPLAY;
+        return 0;
+    }
+
+    static const EGLint config_attributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!ng_egl.bind_api(EGL_OPENGL_API) ||
+        !ng_egl.choose_config(ng_egl_display, config_attributes, &config, 1,
+                              &configs) || configs == 0)
+    {
+        fprintf(stderr, "EGL has no OpenGL config\n");
+        return 0;
+    }
+
+    if (ng_backend == NG_BACKEND_GL33)
+    {
+        ng_egl_context = ng_egl_create_context(config, 1);
+        if (ng_egl_context == EGL_NO_CONTEXT)
+        {
+            fprintf(stderr, "OpenGL 3.3 isn't available, using OpenGL 2.0\n");
+            ng_backend = NG_BACKEND_OPENGL;
+        }
+    }
+    if (ng_egl_context == EGL_NO_CONTEXT)
+        ng_egl_context = ng_egl_create_context(config, 0);
+    if (ng_egl_context == EGL_NO_CONTEXT ||
+        !ng_egl.make_current(ng_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                             ng_egl_context))
+    {
+        fprintf(stderr, "can't make a surfaceless EGL context current: 0x%x\n",
+                ng_egl.get_error());
+        return 0;
+    }
+    ng_egl_width = width;
+    ng_egl_height = height;
+    return 1;
+}
+
+// after glewContextInit, which has the framebuffer functions
+int ng_egl_init_framebuffer()
+{
+    if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object)
+    {
+        fprintf(stderr, "framebuffer objects aren't available\n");
+        return 0;
+    }
+
+    glGenRenderbuffers(1, &ng_egl_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, ng_egl_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, ng_egl_width,
+                          ng_egl_height);
+    glGenFramebuffers(1, &ng_egl_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, ng_egl_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, ng_egl_renderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "the framebuffer object is incomplete\n");
+        return 0;
+    }
+    return 1;
+}
+
+// nothing is shown, so the frame ends when the GPU is done with it and
+// the frame times include its work
+void ng_egl_present()
+{
+    glFinish();
+}
+
+// RGBA, top row first like the software backend
+const unsigned char* ng_egl_get_pixels(int* width, int* height)
+{
+    int y;
+    size_t row = (size_t)ng_egl_width * 4;
+    if (ng_egl_framebuffer == 0)
+        return NULL;
+    if (ng_egl_pixels == NULL)
+    {
+        ng_egl_pixels = malloc(row * ng_egl_height * 2);
+        if (ng_egl_pixels == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return NULL;
+        }
+    }
+
+    unsigned char* bottom_up = ng_egl_pixels + row * ng_egl_height;
+    ng_gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, ng_egl_width, ng_egl_height, GL_RGBA, GL_UNSIGNED_BYTE,
+                 bottom_up);
+    for (y = 0; y < ng_egl_height; ++y)
+        memcpy(ng_egl_pixels + row * y,
+               bottom_up + row * (ng_egl_height - 1 - y), row);
+
+    *width = ng_egl_width;
+    *height = ng_egl_height;
+    return ng_egl_pixels;
+}
+
+// runs after ng_free_resources, which still needs the context
+void ng_egl_free()
+{
+    if (ng_egl_display == EGL_NO_DISPLAY)
+        return;
+    if (ng_egl_framebuffer != 0)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &ng_egl_framebuffer);
+        glDeleteRenderbuffers(1, &ng_egl_renderbuffer);
+    }
+    ng_egl_framebuffer = ng_egl_renderbuffer = 0;
+    free(ng_egl_pixels);
+    ng_egl_pixels = NULL;
+
+    ng_egl.make_current(ng_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        EGL_NO_CONTEXT);
+    if (ng_egl_context != EGL_NO_CONTEXT)
+        ng_egl.destroy_context(ng_egl_display, ng_egl_context);
+    ng_egl.terminate(ng_egl_display);
+    ng_egl_context = EGL_NO_CONTEXT;
+    ng_egl_display = EGL_NO_DISPLAY;
+}
+
+// the library stays loaded, the driver may still have work at exit
+int ng_egl_load()
+{
+    if (ng_egl.library != NULL)
+        return 1;
+    ng_egl.library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (ng_egl.library == NULL)
+        ng_egl.library = dlopen("libEGL.so", RTLD_NOW | RTLD_LOCAL);
+    if (ng_egl.library == NULL)
+    {
+        fprintf(stderr, "libEGL isn't available: %s\n", dlerror());
+        return 0;
+    }
+
+    ng_egl.query_string = (PFNEGLQUERYSTRINGPROC)ng_egl_symbol("eglQueryString");
+    ng_egl.get_proc_address =
+        (PFNEGLGETPROCADDRESSPROC)ng_egl_symbol("eglGetProcAddress");
+    ng_egl.initialize = (PFNEGLINITIALIZEPROC)ng_egl_symbol("eglInitialize");
+    ng_egl.bind_api = (PFNEGLBINDAPIPROC)ng_egl_symbol("eglBindAPI");
+    ng_egl.choose_config =
+        (PFNEGLCHOOSECONFIGPROC)ng_egl_symbol("eglChooseConfig");
+    ng_egl.create_context =
+        (PFNEGLCREATECONTEXTPROC)ng_egl_symbol("eglCreateContext");
+    ng_egl.make_current = (PFNEGLMAKECURRENTPROC)ng_egl_symbol("eglMakeCurrent");
+    ng_egl.get_error = (PFNEGLGETERRORPROC)ng_egl_symbol("eglGetError");
+    ng_egl.destroy_context =
+        (PFNEGLDESTROYCONTEXTPROC)ng_egl_symbol("eglDestroyContext");
+    ng_egl.terminate = (PFNEGLTERMINATEPROC)ng_egl_symbol("eglTerminate");
+    if (ng_egl.query_string == NULL || ng_egl.get_proc_address == NULL ||
+        ng_egl.initialize == NULL || ng_egl.bind_api == NULL ||
+        ng_egl.choose_config == NULL || ng_egl.create_context == NULL ||
+        ng_egl.make_current == NULL || ng_egl.get_error == NULL ||
+        ng_egl.destroy_context == NULL || ng_egl.terminate == NULL)
+    {
+        fprintf(stderr, "libEGL is missing functions\n");
+        dlclose(ng_egl.library);
+        memset(&ng_egl, 0, sizeof(ng_egl));
+        return 0;
+    }
+    return 1;
+}
+
+void* ng_egl_symbol(const char* name)
+{
+    return dlsym(ng_egl.library, name);
+}
+
+// the 3.3 core profile, or whatever the driver's default is
+EGLContext ng_egl_create_context(EGLConfig config, int core)
+{
+    static const EGLint core_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    return ng_egl.create_context(ng_egl_display, config, EGL_NO_CONTEXT,
+                                 core ? core_attributes : NULL);
+}
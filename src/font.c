@@ -0,0 +1,228 @@
+#include "internal.h"
+#include <string.h>
+
+/* Printable ASCII glyphs of the X11 misc-fixed 9x15 font, the face behind
+   GLUT_BITMAP_9_BY_15. Rows go bottom to top like glBitmap data, the
+   leftmost pixel of a row is bit 15. */
+const unsigned short ng_font_glyphs[NG_FONT_GLYPHS][NG_FONT_HEIGHT] = {
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* space */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x0800, 0x0000, 0x0000,
+      0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x0000 }, /* '!' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x1200, 0x1200, 0x1200, 0x0000, 0x0000 }, /* '"' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x2400, 0x2400, 0x7e00,
+      0x2400, 0x2400, 0x7e00, 0x2400, 0x2400, 0x0000, 0x0000, 0x0000 }, /* '#' */
+    { 0x0000, 0x0000, 0x0000, 0x0800, 0x3e00, 0x4900, 0x0900, 0x0900,
+      0x0a00, 0x1c00, 0x2800, 0x4800, 0x4900, 0x3e00, 0x0800, 0x0000 }, /* '$' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4200, 0x2500, 0x2500, 0x1200,
+      0x0800, 0x0800, 0x2400, 0x5200, 0x5200, 0x2100, 0x0000, 0x0000 }, /* '%' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3100, 0x4a00, 0x4400, 0x4a00,
+      0x3100, 0x3000, 0x4800, 0x4800, 0x4800, 0x3000, 0x0000, 0x0000 }, /* '&' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x1000, 0x0800, 0x0400, 0x0600, 0x0000, 0x0000 }, /* ''' */
+    { 0x0000, 0x0000, 0x0000, 0x0400, 0x0800, 0x0800, 0x1000, 0x1000,
+      0x1000, 0x1000, 0x1000, 0x1000, 0x0800, 0x0800, 0x0400, 0x0000 }, /* '(' */
+    { 0x0000, 0x0000, 0x0000, 0x1000, 0x0800, 0x0800, 0x0400, 0x0400,
+      0x0400, 0x0400, 0x0400, 0x0400, 0x0800, 0x0800, 0x1000, 0x0000 }, /* ')' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x4900, 0x2a00,
+      0x1c00, 0x2a00, 0x4900, 0x0800, 0x0000, 0x0000, 0x0000, 0x0000 }, /* '*' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x0800, 0x0800,
+      0x7f00, 0x0800, 0x0800, 0x0800, 0x0000, 0x0000, 0x0000, 0x0000 }, /* '+' */
+    { 0x0000, 0x0800, 0x0400, 0x0400, 0x0c00, 0x0c00, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* ',' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x7f00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* '-' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0c00, 0x0c00, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* '.' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4000, 0x2000, 0x2000, 0x1000,
+      0x0800, 0x0800, 0x0400, 0x0200, 0x0200, 0x0100, 0x0000, 0x0000 }, /* '/' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x1c00, 0x2200, 0x4100, 0x4100,
+      0x4100, 0x4100, 0x4100, 0x4100, 0x2200, 0x1c00, 0x0000, 0x0000 }, /* '0' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x4800, 0x2800, 0x1800, 0x0800, 0x0000, 0x0000 }, /* '1' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x4000, 0x2000, 0x1000,
+      0x0800, 0x0400, 0x0200, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* '2' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x0100, 0x0100,
+      0x0100, 0x0e00, 0x0400, 0x0200, 0x0100, 0x7f00, 0x0000, 0x0000 }, /* '3' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0200, 0x0200, 0x0200, 0x7f00,
+      0x4200, 0x2200, 0x1200, 0x0a00, 0x0600, 0x0200, 0x0000, 0x0000 }, /* '4' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x0100, 0x0100,
+      0x0100, 0x6100, 0x5e00, 0x4000, 0x4000, 0x7f00, 0x0000, 0x0000 }, /* '5' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4100, 0x4100,
+      0x6100, 0x5e00, 0x4000, 0x4000, 0x2000, 0x1e00, 0x0000, 0x0000 }, /* '6' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x2000, 0x2000, 0x1000, 0x1000,
+      0x0800, 0x0400, 0x0200, 0x0100, 0x0100, 0x7f00, 0x0000, 0x0000 }, /* '7' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x1c00, 0x2200, 0x4100, 0x4100,
+      0x2200, 0x1c00, 0x2200, 0x4100, 0x2200, 0x1c00, 0x0000, 0x0000 }, /* '8' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3c00, 0x0200, 0x0100, 0x0100,
+      0x3d00, 0x4300, 0x4100, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* '9' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0c00, 0x0c00, 0x0000, 0x0000,
+      0x0000, 0x0c00, 0x0c00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* ':' */
+    { 0x0000, 0x0800, 0x0400, 0x0400, 0x0c00, 0x0c00, 0x0000, 0x0000,
+      0x0000, 0x0c00, 0x0c00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* ';' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0200, 0x0400, 0x0800, 0x1000,
+      0x2000, 0x2000, 0x1000, 0x0800, 0x0400, 0x0200, 0x0000, 0x0000 }, /* '<' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x0000,
+      0x0000, 0x7f00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* '=' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x2000, 0x1000, 0x0800, 0x0400,
+      0x0200, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x0000, 0x0000 }, /* '>' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x0000, 0x0800, 0x0800,
+      0x0400, 0x0200, 0x0100, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* '?' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4000, 0x4000, 0x4d00,
+      0x5300, 0x5100, 0x4f00, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* '@' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4100, 0x7f00,
+      0x4100, 0x4100, 0x4100, 0x2200, 0x1400, 0x0800, 0x0000, 0x0000 }, /* 'A' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7e00, 0x2100, 0x2100, 0x2100,
+      0x2100, 0x7e00, 0x2100, 0x2100, 0x2100, 0x7e00, 0x0000, 0x0000 }, /* 'B' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4000, 0x4000,
+      0x4000, 0x4000, 0x4000, 0x4000, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* 'C' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7e00, 0x2100, 0x2100, 0x2100,
+      0x2100, 0x2100, 0x2100, 0x2100, 0x2100, 0x7e00, 0x0000, 0x0000 }, /* 'D' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x2000, 0x2000, 0x2000,
+      0x2000, 0x3c00, 0x2000, 0x2000, 0x2000, 0x7f00, 0x0000, 0x0000 }, /* 'E' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x2000, 0x2000, 0x2000, 0x2000,
+      0x2000, 0x3c00, 0x2000, 0x2000, 0x2000, 0x7f00, 0x0000, 0x0000 }, /* 'F' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4100, 0x4100,
+      0x4700, 0x4000, 0x4000, 0x4000, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* 'G' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4100, 0x4100,
+      0x4100, 0x7f00, 0x4100, 0x4100, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'H' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x3e00, 0x0000, 0x0000 }, /* 'I' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3c00, 0x4200, 0x0200, 0x0200,
+      0x0200, 0x0200, 0x0200, 0x0200, 0x0200, 0x0f80, 0x0000, 0x0000 }, /* 'J' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4200, 0x4400, 0x4800,
+      0x5000, 0x7000, 0x4800, 0x4400, 0x4200, 0x4100, 0x0000, 0x0000 }, /* 'K' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x4000, 0x4000, 0x4000,
+      0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x0000, 0x0000 }, /* 'L' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4100, 0x4900,
+      0x4900, 0x5500, 0x5500, 0x6300, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'M' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4100, 0x4300,
+      0x4500, 0x4900, 0x5100, 0x6100, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'N' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4100, 0x4100,
+      0x4100, 0x4100, 0x4100, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* 'O' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4000, 0x4000, 0x4000, 0x4000,
+      0x4000, 0x7e00, 0x4100, 0x4100, 0x4100, 0x7e00, 0x0000, 0x0000 }, /* 'P' */
+    { 0x0000, 0x0000, 0x0300, 0x0400, 0x3e00, 0x4900, 0x5100, 0x4100,
+      0x4100, 0x4100, 0x4100, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* 'Q' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4200, 0x4400,
+      0x4800, 0x7e00, 0x4100, 0x4100, 0x4100, 0x7e00, 0x0000, 0x0000 }, /* 'R' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4100, 0x0100,
+      0x0600, 0x3800, 0x4000, 0x4100, 0x4100, 0x3e00, 0x0000, 0x0000 }, /* 'S' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x7f00, 0x0000, 0x0000 }, /* 'T' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4100, 0x4100,
+      0x4100, 0x4100, 0x4100, 0x4100, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'U' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x1400, 0x1400, 0x1400,
+      0x2200, 0x2200, 0x2200, 0x4100, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'V' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x2200, 0x5500, 0x4900, 0x4900,
+      0x4900, 0x4900, 0x4100, 0x4100, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'W' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x2200, 0x1400,
+      0x0800, 0x0800, 0x1400, 0x2200, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'X' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x1400, 0x2200, 0x4100, 0x4100, 0x0000, 0x0000 }, /* 'Y' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x4000, 0x4000, 0x2000,
+      0x1000, 0x0800, 0x0400, 0x0200, 0x0100, 0x7f00, 0x0000, 0x0000 }, /* 'Z' */
+    { 0x0000, 0x0000, 0x0000, 0x1e00, 0x1000, 0x1000, 0x1000, 0x1000,
+      0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1e00, 0x0000 }, /* '[' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0100, 0x0200, 0x0200, 0x0400,
+      0x0800, 0x0800, 0x1000, 0x2000, 0x2000, 0x4000, 0x0000, 0x0000 }, /* backslash */
+    { 0x0000, 0x0000, 0x0000, 0x3c00, 0x0400, 0x0400, 0x0400, 0x0400,
+      0x0400, 0x0400, 0x0400, 0x0400, 0x0400, 0x0400, 0x3c00, 0x0000 }, /* ']' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x4100, 0x2200, 0x1400, 0x0800, 0x0000, 0x0000 }, /* '^' */
+    { 0x0000, 0x0000, 0x0000, 0xff00, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* '_' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x0400, 0x0800, 0x1000, 0x3000, 0x0000 }, /* '`' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3d00, 0x4300, 0x4100, 0x3f00,
+      0x0100, 0x0100, 0x3e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'a' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x5e00, 0x6100, 0x4100, 0x4100,
+      0x4100, 0x6100, 0x5e00, 0x4000, 0x4000, 0x4000, 0x0000, 0x0000 }, /* 'b' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4000, 0x4000,
+      0x4000, 0x4100, 0x3e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'c' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3d00, 0x4300, 0x4100, 0x4100,
+      0x4100, 0x4300, 0x3d00, 0x0100, 0x0100, 0x0100, 0x0000, 0x0000 }, /* 'd' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4000, 0x4000, 0x7f00,
+      0x4100, 0x4100, 0x3e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'e' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x1000, 0x1000, 0x1000, 0x1000,
+      0x7c00, 0x1000, 0x1000, 0x1100, 0x1100, 0x0e00, 0x0000, 0x0000 }, /* 'f' */
+    { 0x0000, 0x3e00, 0x4100, 0x4100, 0x3e00, 0x4000, 0x3c00, 0x4200,
+      0x4200, 0x4200, 0x3d00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'g' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4100, 0x4100,
+      0x4100, 0x6100, 0x5e00, 0x4000, 0x4000, 0x4000, 0x0000, 0x0000 }, /* 'h' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x3800, 0x0000, 0x0000, 0x1800, 0x0000, 0x0000 }, /* 'i' */
+    { 0x0000, 0x3c00, 0x4200, 0x4200, 0x4200, 0x0200, 0x0200, 0x0200,
+      0x0200, 0x0200, 0x0e00, 0x0000, 0x0000, 0x0600, 0x0000, 0x0000 }, /* 'j' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4600, 0x5800, 0x6000,
+      0x5800, 0x4600, 0x4100, 0x4000, 0x4000, 0x4000, 0x0000, 0x0000 }, /* 'k' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x3800, 0x0000, 0x0000 }, /* 'l' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4900, 0x4900, 0x4900,
+      0x4900, 0x4900, 0x7600, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'm' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x4100, 0x4100, 0x4100,
+      0x4100, 0x6100, 0x5e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'n' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x4100, 0x4100,
+      0x4100, 0x4100, 0x3e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'o' */
+    { 0x0000, 0x4000, 0x4000, 0x4000, 0x5e00, 0x6100, 0x4100, 0x4100,
+      0x4100, 0x6100, 0x5e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'p' */
+    { 0x0000, 0x0100, 0x0100, 0x0100, 0x3d00, 0x4300, 0x4100, 0x4100,
+      0x4100, 0x4300, 0x3d00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'q' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x2000, 0x2000, 0x2000, 0x2000,
+      0x2100, 0x3100, 0x4e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'r' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3e00, 0x4100, 0x0100, 0x3e00,
+      0x4000, 0x4100, 0x3e00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 's' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0e00, 0x1100, 0x1000, 0x1000,
+      0x1000, 0x1000, 0x7e00, 0x1000, 0x1000, 0x0000, 0x0000, 0x0000 }, /* 't' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x3d00, 0x4200, 0x4200, 0x4200,
+      0x4200, 0x4200, 0x4200, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'u' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x1400, 0x1400, 0x2200,
+      0x2200, 0x4100, 0x4100, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'v' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x2200, 0x5500, 0x4900, 0x4900,
+      0x4900, 0x4100, 0x4100, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'w' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x4100, 0x2200, 0x1400, 0x0800,
+      0x1400, 0x2200, 0x4100, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'x' */
+    { 0x0000, 0x3c00, 0x4200, 0x0200, 0x3a00, 0x4600, 0x4200, 0x4200,
+      0x4200, 0x4200, 0x4200, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'y' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x7f00, 0x2000, 0x1000, 0x0800,
+      0x0400, 0x0200, 0x7f00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 }, /* 'z' */
+    { 0x0000, 0x0000, 0x0000, 0x0700, 0x0800, 0x0800, 0x0800, 0x0400,
+      0x1800, 0x1800, 0x0400, 0x0800, 0x0800, 0x0800, 0x0700, 0x0000 }, /* '{' */
+    { 0x0000, 0x0000, 0x0000, 0x0800, 0x0800, 0x0800, 0x0800, 0x0800,
+      0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x0800, 0x0000 }, /* '|' */
+    { 0x0000, 0x0000, 0x0000, 0x7000, 0x0800, 0x0800, 0x0800, 0x1000,
+      0x0c00, 0x0c00, 0x1000, 0x0800, 0x0800, 0x0800, 0x7000, 0x0000 }, /* '}' */
+    { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+      0x0000, 0x0000, 0x0000, 0x4600, 0x4900, 0x3100, 0x0000, 0x0000 }  /* '~' */
+};
+
+// white glyphs with coverage in alpha, row 0 at the bottom as glTexImage2D
+// expects, and an opaque white block solid primitives sample from
+void ng_font_bake(GLubyte* rgba)
+{
+    int c, row, i;
+    memset(rgba, 0, NG_FONT_ATLAS_WIDTH * NG_FONT_ATLAS_HEIGHT * 4);
+
+    for (c = 0; c < NG_FONT_GLYPHS; ++c)
+    {
+        int x0 = (c % NG_FONT_ATLAS_COLUMNS) * NG_FONT_WIDTH;
+        int y0 = (c / NG_FONT_ATLAS_COLUMNS) * NG_FONT_HEIGHT;
+        for (row = 0; row < NG_FONT_HEIGHT; ++row)
+        {
+            GLubyte* p = rgba + ((y0 + row) * NG_FONT_ATLAS_WIDTH + x0) * 4;
+            for (i = 0; i < NG_FONT_WIDTH; ++i, p += 4)
+            {
+                p[0] = p[1] = p[2] = 255;
+                p[3] = (ng_font_glyphs[c][row] & (0x8000u >> i)) ? 255 : 0;
+            }
+        }
+    }
+
+    for (row = NG_FONT_ATLAS_HEIGHT - NG_FONT_WHITE_SIZE; row < NG_FONT_ATLAS_HEIGHT; ++row)
+    {
+        GLubyte* p = rgba + (row * NG_FONT_ATLAS_WIDTH +
+                             NG_FONT_ATLAS_WIDTH - NG_FONT_WHITE_SIZE) * 4;
+        memset(p, 255, NG_FONT_WHITE_SIZE * 4);
+    }
+}
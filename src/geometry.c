@@ -0,0 +1,292 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* vertices drawn with one draw call; segments are contiguous and
+   cover the whole geometry in recording order */
+typedef struct
+{
+    GLenum mode;
+    GLfloat line_width;
+    int page;
+    int first;
+    int count;
+} ng_geometry_segment;
+
+struct ng_geometry
+{
+    GLuint vbo;
+    GLuint vao;
+    int trace_id;
+    int trace_session;
+    int vbo_capacity;
+    ng_vertex* vertices;
+    int size;
+    int capacity;
+    ng_geometry_segment* segments;
+    int segments_size;
+    int segments_capacity;
+    int dirty_first;        // [dirty_first, dirty_end) isn't uploaded yet
+    int dirty_end;
+};
+
+static ng_vertex* ng_geometry_append(ng_geometry* g, GLenum mode, int vertices,
+                                     GLfloat line_width, int page);
+static ng_vertex* ng_geometry_overwrite(ng_geometry* g, GLenum mode,
+                                        int vertices, GLfloat line_width,
+                                        int page);
+static void ng_geometry_upload(ng_geometry* g);
+
+/* the geometry the calling thread records; the cursor is where the
+   next primitive goes while updating and -1 while appending */
+static _Thread_local ng_geometry* ng_recording;
+static _Thread_local int ng_recording_cursor;
+static _Thread_local int ng_recording_segment;
+
+ng_geometry* ng_begin_geometry()
+{
+    if (ng_recording != NULL)
+    {
+        fprintf(stderr, "ng_begin_geometry: already recording\n");
+        return NULL;
+    }
+
+    ng_geometry* g = calloc(1, sizeof(ng_geometry));
+    if (g == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return NULL;
+    }
+
+    ng_recording = g;
+    ng_recording_cursor = -1;
+    if (ng_trace_recording)
+    {
+        g->trace_id = ng_trace_new_geometry();
+        g->trace_session = ng_trace_session;
+        ng_trace_ints(NG_TRACE_BEGIN_GEOMETRY, 1, g->trace_id);
+    }
+    return g;
+}
+
+void ng_begin_geometry_update(ng_geometry* g, int mark)
+{
+    if (ng_recording != NULL)
+    {
+        fprintf(stderr, "ng_begin_geometry_update: already recording\n");
+        return;
+    }
+    if (g == NULL || mark < 0 || mark > g->size)
+    {
+        fprintf(stderr, "ng_begin_geometry_update: bad mark %d\n", mark);
+        return;
+    }
+
+    // find the segment holding the mark
+    int lo = 0, hi = g->segments_size - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (g->segments[mid].first <= mark)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_UPDATE_GEOMETRY, 2,
+                      ng_trace_id(g->trace_id, g->trace_session), mark);
+    ng_recording = g;
+    ng_recording_cursor = mark;
+    ng_recording_segment = lo;
+}
+
+int ng_geometry_mark()
+{
+    if (ng_recording == NULL)
+        return -1;
+
+    int mark = ng_recording_cursor >= 0 ? ng_recording_cursor
+                                        : ng_recording->size;
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_GEOMETRY_MARK, 1, mark);
+    return mark;
+}
+
+void ng_end_geometry()
+{
+    ng_geometry* g = ng_recording;
+    if (g == NULL)
+        return;
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_END_GEOMETRY, 0);
+
+    ng_recording = NULL;
+}
+
+void ng_draw_geometry(const ng_geometry* g)
+{
+    if (g == NULL || g == ng_recording)
+        return;
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_DRAW_GEOMETRY, 1,
+                      ng_trace_id(g->trace_id, g->trace_session));
+
+    int i;
+    if (ng_geometry_recording())
+    {
+        // into the geometry being recorded, like a command list
+        for (i = 0; i < g->segments_size; ++i)
+        {
+            const ng_geometry_segment* s = &g->segments[i];
+            ng_vertex* v = ng_batch_reserve(s->mode, s->count, s->line_width,
+                                            s->page);
+            if (v == NULL)
+                return;
+            memcpy(v, g->vertices + s->first, s->count * sizeof(ng_vertex));
+        }
+        return;
+    }
+
+    ng_batch_flush();
+
+    // the thread with the context uploads; command lists copy the
+    // vertices from the array instead
+    if (ng_backend != NG_BACKEND_SOFTWARE && !ng_commands_recording() &&
+        g->dirty_first < g->dirty_end)
+        ng_geometry_upload((ng_geometry*)g);
+
+    for (i = 0; i < g->segments_size; ++i)
+    {
+        const ng_geometry_segment* s = &g->segments[i];
+        ng_draw_vertices(g->vbo, (GLuint*)&g->vao, g->vertices, s->mode,
+                         s->first, s->count, s->line_width, s->page);
+    }
+}
+
+void ng_free_geometry(ng_geometry* g)
+{
+    if (g == NULL)
+        return;
+    if (ng_trace_recording && ng_trace_id(g->trace_id, g->trace_session) != 0)
+        ng_trace_ints(NG_TRACE_FREE_GEOMETRY, 1, g->trace_id);
+    if (g == ng_recording)
+        ng_recording = NULL;
+    if (g->vao != 0)
+        ng_gl_delete_vertex_array(g->vao);
+    if (g->vbo != 0)
+        ng_gl_delete_buffer(g->vbo);
+    free(g->vertices);
+    free(g->segments);
+    free(g);
+}
+
+int ng_geometry_recording()
+{
+    return ng_recording != NULL;
+}
+
+ng_vertex* ng_geometry_reserve(GLenum mode, int vertices, GLfloat line_width,
+                               int page)
+{
+    ng_geometry* g = ng_recording;
+    ng_vertex* v;
+
+    // an update that reaches the end goes on appending
+    if (ng_recording_cursor == g->size)
+        ng_recording_cursor = -1;
+
+    if (ng_recording_cursor >= 0)
+        v = ng_geometry_overwrite(g, mode, vertices, line_width, page);
+    else
+        v = ng_geometry_append(g, mode, vertices, line_width, page);
+    if (v == NULL)
+        return NULL;
+
+    int first = (int)(v - g->vertices);
+    if (g->dirty_first == g->dirty_end || first < g->dirty_first)
+        g->dirty_first = first;
+    if (first + vertices > g->dirty_end)
+        g->dirty_end = first + vertices;
+    return v;
+}
+
+ng_vertex* ng_geometry_append(ng_geometry* g, GLenum mode, int vertices,
+                              GLfloat line_width, int page)
+{
+    ng_vertex* v = ng_grow(g->vertices, &g->capacity,
+                           g->size + vertices, sizeof(ng_vertex));
+    if (v == NULL)
+        return NULL;
+    g->vertices = v;
+
+    ng_geometry_segment* s = g->segments_size > 0
+        ? &g->segments[g->segments_size - 1] : NULL;
+    if (s == NULL || s->mode != mode ||
+        (page != NG_ANY_PAGE && s->page != page) ||
+        (mode == GL_LINES && s->line_width != line_width))
+    {
+        s = ng_grow(g->segments, &g->segments_capacity,
+                    g->segments_size + 1, sizeof(ng_geometry_segment));
+        if (s == NULL)
+            return NULL;
+        g->segments = s;
+        s = &g->segments[g->segments_size++];
+        s->mode = mode;
+        s->line_width = line_width;
+        s->page = page != NG_ANY_PAGE ? page : 0;
+        s->first = g->size;
+        s->count = 0;
+    }
+
+    s->count += vertices;
+    v = g->vertices + g->size;
+    g->size += vertices;
+    return v;
+}
+
+// an update may change positions and colors but has to repeat the
+// primitives that were recorded there
+ng_vertex* ng_geometry_overwrite(ng_geometry* g, GLenum mode, int vertices,
+                                 GLfloat line_width, int page)
+{
+    ng_geometry_segment* s = &g->segments[ng_recording_segment];
+    while (ng_recording_cursor >= s->first + s->count)
+        s = &g->segments[++ng_recording_segment];
+
+    if (s->mode != mode ||
+        (page != NG_ANY_PAGE && s->page != page) ||
+        (mode == GL_LINES && s->line_width != line_width) ||
+        ng_recording_cursor + vertices > s->first + s->count)
+    {
+        fprintf(stderr, "geometry update doesn't match the recorded primitives\n");
+        return NULL;
+    }
+
+    ng_vertex* v = g->vertices + ng_recording_cursor;
+    ng_recording_cursor += vertices;
+    return v;
+}
+
+// the buffer keeps the array's capacity so appending rarely reallocates it
+void ng_geometry_upload(ng_geometry* g)
+{
+    if (g->vbo == 0)
+        glGenBuffers(1, &g->vbo);
+    ng_gl_bind_buffer(GL_ARRAY_BUFFER, g->vbo);
+
+    if (g->size > g->vbo_capacity)
+    {
+        glBufferData(GL_ARRAY_BUFFER, g->capacity * sizeof(ng_vertex), NULL,
+                     GL_STATIC_DRAW);
+        g->vbo_capacity = g->capacity;
+        g->dirty_first = 0;
+        g->dirty_end = g->size;
+    }
+
+    glBufferSubData(GL_ARRAY_BUFFER, g->dirty_first * sizeof(ng_vertex),
+                    (g->dirty_end - g->dirty_first) * sizeof(ng_vertex),
+                    g->vertices + g->dirty_first);
+    g->dirty_first = g->dirty_end = 0;
+}
@@ -0,0 +1,229 @@
+#include "internal.h"
+#include <stddef.h>
+
+#define NG_GL_MAX_ATTRIBUTES 8
+
+/* a shadow of the GL state the library changes, starting from the
+   context defaults; a call that wouldn't change anything isn't issued
+   and is counted as avoided by the profiler. Enabled attributes, their
+   divisors and the element buffer belong to the bound vertex array, so
+   binding another one makes them unknown until they are set again */
+static GLuint ng_gl_program;
+static GLuint ng_gl_texture;
+static GLuint ng_gl_array_buffer;
+static GLuint ng_gl_element_buffer;
+static GLuint ng_gl_pack_buffer;
+static GLuint ng_gl_unpack_buffer;
+static GLuint ng_gl_vertex_array;
+static unsigned int ng_gl_attributes;
+static GLuint ng_gl_divisors[NG_GL_MAX_ATTRIBUTES];
+static int ng_gl_vertex_state_known = 1;
+static GLfloat ng_gl_line_width_value = 1.0f;
+static int ng_gl_blend_enabled;
+static GLenum ng_gl_blend_src = GL_ONE;
+static GLenum ng_gl_blend_dst = GL_ZERO;
+static int ng_gl_scissor_enabled;
+static GLint ng_gl_scissor_box[4];
+
+static GLuint* ng_gl_buffer_binding(GLenum target);
+
+void ng_gl_use_program(GLuint program)
+{
+    int avoided = program == ng_gl_program;
+    if (!avoided)
+        glUseProgram(program);
+    ng_gl_program = program;
+    ng_profile_gl_call(avoided);
+}
+
+void ng_gl_bind_texture(GLuint texture)
+{
+    int avoided = texture == ng_gl_texture;
+    if (!avoided)
+        glBindTexture(GL_TEXTURE_2D, texture);
+    ng_gl_texture = texture;
+    ng_profile_gl_call(avoided);
+}
+
+void ng_gl_bind_buffer(GLenum target, GLuint buffer)
+{
+    GLuint* binding = ng_gl_buffer_binding(target);
+    int avoided = binding != NULL && *binding == buffer;
+    if (!avoided)
+        glBindBuffer(target, buffer);
+    if (binding != NULL)
+        *binding = buffer;
+    ng_profile_gl_call(avoided);
+}
+
+void ng_gl_bind_vertex_array(GLuint vao)
+{
+    int avoided = vao == ng_gl_vertex_array;
+    if (!avoided)
+    {
+        glBindVertexArray(vao);
+        ng_gl_vertex_state_known = 0;
+        ng_gl_element_buffer = (GLuint)-1;
+    }
+    ng_gl_vertex_array = vao;
+    ng_profile_gl_call(avoided);
+}
+
+// enables the attribute arrays in mask and disables the others
+void ng_gl_enable_attributes(unsigned int mask)
+{
+    int i;
+    unsigned int changed = ng_gl_vertex_state_known
+        ? mask ^ ng_gl_attributes : ~0u;
+    for (i = 0; i < NG_GL_MAX_ATTRIBUTES; ++i)
+    {
+        unsigned int bit = 1u << i;
+        if (changed & bit)
+        {
+            if (mask & bit)
+                glEnableVertexAttribArray(i);
+            else
+                glDisableVertexAttribArray(i);
+            ng_profile_gl_call(0);
+        }
+        else if (mask & bit)
+        {
+            ng_profile_gl_call(1);
+        }
+    }
+    ng_gl_attributes = mask;
+    if (!ng_gl_vertex_state_known)
+    {
+        for (i = 0; i < NG_GL_MAX_ATTRIBUTES; ++i)
+            ng_gl_divisors[i] = 0;
+        ng_gl_vertex_state_known = 1;
+    }
+}
+
+// a vertex array starts with zero divisors and the GL 2.0 path only sets
+// others when instanced arrays exist, so resetting to zero never reaches
+// GL without them
+void ng_gl_attribute_divisor(GLuint index, GLuint divisor)
+{
+    int avoided = ng_gl_divisors[index] == divisor;
+    if (!avoided)
+    {
+        if (ng_backend == NG_BACKEND_GL33)
+            glVertexAttribDivisor(index, divisor);
+        else
+            glVertexAttribDivisorARB(index, divisor);
+    }
+    ng_gl_divisors[index] = divisor;
+    ng_profile_gl_call(avoided);
+}
+
+void ng_gl_line_width(GLfloat width)
+{
+    int avoided = width == ng_gl_line_width_value;
+    if (!avoided)
+        glLineWidth(width);
+    ng_gl_line_width_value = width;
+    ng_profile_gl_call(avoided);
+}
+
+void ng_gl_blend(int enabled, GLenum src, GLenum dst)
+{
+    int avoided = enabled == ng_gl_blend_enabled;
+    if (!avoided)
+    {
+        if (enabled)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+    }
+    ng_gl_blend_enabled = enabled;
+    ng_profile_gl_call(avoided);
+
+    avoided = src == ng_gl_blend_src && dst == ng_gl_blend_dst;
+    if (!avoided)
+        glBlendFunc(src, dst);
+    ng_gl_blend_src = src;
+    ng_gl_blend_dst = dst;
+    ng_profile_gl_call(avoided);
+}
+
+// the box only matters, and is only compared, while the test is enabled
+void ng_gl_scissor(int enabled, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    int avoided = enabled == ng_gl_scissor_enabled;
+    if (!avoided)
+    {
+        if (enabled)
+            glEnable(GL_SCISSOR_TEST);
+        else
+            glDisable(GL_SCISSOR_TEST);
+    }
+    ng_gl_scissor_enabled = enabled;
+    ng_profile_gl_call(avoided);
+    if (!enabled)
+        return;
+
+    avoided = ng_gl_scissor_box[0] == x && ng_gl_scissor_box[1] == y &&
+              ng_gl_scissor_box[2] == width && ng_gl_scissor_box[3] == height;
+    if (!avoided)
+        glScissor(x, y, width, height);
+    ng_gl_scissor_box[0] = x;
+    ng_gl_scissor_box[1] = y;
+    ng_gl_scissor_box[2] = width;
+    ng_gl_scissor_box[3] = height;
+    ng_profile_gl_call(avoided);
+}
+
+// GL unbinds deleted objects, and their names can come back from glGen*
+void ng_gl_delete_buffer(GLuint buffer)
+{
+    if (ng_gl_array_buffer == buffer)
+        ng_gl_array_buffer = 0;
+    if (ng_gl_element_buffer == buffer)
+        ng_gl_element_buffer = 0;
+    if (ng_gl_pack_buffer == buffer)
+        ng_gl_pack_buffer = 0;
+    if (ng_gl_unpack_buffer == buffer)
+        ng_gl_unpack_buffer = 0;
+    glDeleteBuffers(1, &buffer);
+}
+
+void ng_gl_delete_texture(GLuint texture)
+{
+    if (ng_gl_texture == texture)
+        ng_gl_texture = 0;
+    glDeleteTextures(1, &texture);
+}
+
+void ng_gl_delete_vertex_array(GLuint vao)
+{
+    if (ng_gl_vertex_array == vao)
+    {
+        ng_gl_vertex_array = 0;
+        ng_gl_vertex_state_known = 0;
+    }
+    glDeleteVertexArrays(1, &vao);
+}
+
+void ng_gl_delete_program(GLuint program)
+{
+    if (ng_gl_program == program)
+        ng_gl_program = 0;
+    glDeleteProgram(program);
+}
+
+GLuint* ng_gl_buffer_binding(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER:
+        return &ng_gl_array_buffer;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        return &ng_gl_element_buffer;
+    case GL_PIXEL_PACK_BUFFER:
+        return &ng_gl_pack_buffer;
+    case GL_PIXEL_UNPACK_BUFFER:
+        return &ng_gl_unpack_buffer;
+    }
+    return NULL;
+}
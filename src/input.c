@@ -0,0 +1,160 @@
+#include "internal.h"
+#include <pthread.h>
+
+/* GLUT callbacks only append here; the queue is drained either by the
+   application through ng_poll_event() or, for programs that use only
+   ng_get_keyboard/ng_get_mouse, by ng_input_feed() before every update.
+   Fed events stay queued until the next feed, so a program that starts
+   polling in its first update still sees them. With a render thread
+   the callbacks and the application are on different threads, so the
+   queue has a lock. */
+static ng_event ng_events[NG_EVENT_QUEUE_SIZE];
+static int ng_events_head;
+static int ng_events_size;
+static int ng_events_dropped;
+static int ng_events_polled;
+static int ng_events_fed;
+static pthread_mutex_t ng_events_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int ng_mouse_x;
+static int ng_mouse_y;
+static int ng_mouse_button;
+static int ng_mouse_state = RELEASED;
+static unsigned char ng_keyboard_key;
+static int ng_keyboard_state = RELEASED;
+// the size the window thread last saw, for the application's thread
+static int ng_window_width;
+static int ng_window_height;
+
+static void ng_input_apply(const ng_event* e);
+
+void ng_input_push(const ng_event* event)
+{
+    ng_event* last = NULL;
+    pthread_mutex_lock(&ng_events_mutex);
+    if (ng_events_size > ng_events_fed && !ng_events_polled)
+        last = &ng_events[(ng_events_head + ng_events_size - 1) %
+                          NG_EVENT_QUEUE_SIZE];
+
+    // consecutive moves collapse into the latest position, unless the
+    // last one was already fed, which the next feed steps over
+    if (event->type == NG_EVENT_MOUSE_MOVE && last != NULL &&
+        last->type == NG_EVENT_MOUSE_MOVE)
+        *last = *event;
+    else if (ng_events_size == NG_EVENT_QUEUE_SIZE)
+        ++ng_events_dropped;
+    else
+    {
+        ng_events[(ng_events_head + ng_events_size) % NG_EVENT_QUEUE_SIZE] =
+            *event;
+        ++ng_events_size;
+    }
+    pthread_mutex_unlock(&ng_events_mutex);
+}
+
+int ng_poll_event(ng_event* event)
+{
+    pthread_mutex_lock(&ng_events_mutex);
+    ng_events_polled = 1;
+    int found = ng_events_size > 0;
+    if (found)
+    {
+        *event = ng_events[ng_events_head];
+        ng_events_head = (ng_events_head + 1) % NG_EVENT_QUEUE_SIZE;
+        --ng_events_size;
+        if (ng_events_fed > 0)
+            --ng_events_fed;
+        ng_input_apply(event);
+    }
+    pthread_mutex_unlock(&ng_events_mutex);
+    return found;
+}
+
+int ng_get_dropped_events()
+{
+    pthread_mutex_lock(&ng_events_mutex);
+    int dropped = ng_events_dropped;
+    pthread_mutex_unlock(&ng_events_mutex);
+    return dropped;
+}
+
+// hands queued events to the legacy getters, stopping after the first
+// key event so every keystroke is seen by one update
+void ng_input_feed()
+{
+    pthread_mutex_lock(&ng_events_mutex);
+    if (ng_events_polled)
+    {
+        pthread_mutex_unlock(&ng_events_mutex);
+        return;
+    }
+
+    ng_events_head = (ng_events_head + ng_events_fed) % NG_EVENT_QUEUE_SIZE;
+    ng_events_size -= ng_events_fed;
+    ng_events_fed = 0;
+
+    while (ng_events_fed < ng_events_size)
+    {
+        const ng_event* e = &ng_events[(ng_events_head + ng_events_fed) %
+                                       NG_EVENT_QUEUE_SIZE];
+        ++ng_events_fed;
+        ng_input_apply(e);
+        if (e->type == NG_EVENT_KEY_PRESS || e->type == NG_EVENT_KEY_RELEASE)
+            break;
+    }
+    pthread_mutex_unlock(&ng_events_mutex);
+}
+
+void ng_input_apply(const ng_event* e)
+{
+    ng_mouse_x = e->x;
+    ng_mouse_y = e->y;
+
+    switch (e->type)
+    {
+    case NG_EVENT_KEY_PRESS:
+        ng_keyboard_key = e->key;
+        ng_keyboard_state = PRESSED;
+        break;
+    case NG_EVENT_KEY_RELEASE:
+        ng_keyboard_key = e->key;
+        ng_keyboard_state = RELEASED;
+        break;
+    case NG_EVENT_MOUSE_BUTTON:
+        ng_mouse_button = e->button;
+        ng_mouse_state = e->state;
+        break;
+    }
+}
+
+void ng_get_mouse(int* x, int* y, int* button, int* state)
+{
+    *x = ng_mouse_x;
+    *y = ng_mouse_y;
+    *button = ng_mouse_button;
+    *state = ng_mouse_state;
+}
+
+void ng_input_resize(int width, int height)
+{
+    pthread_mutex_lock(&ng_events_mutex);
+    ng_window_width = width;
+    ng_window_height = height;
+    pthread_mutex_unlock(&ng_events_mutex);
+}
+
+int ng_get_window_size(int* width, int* height)
+{
+    pthread_mutex_lock(&ng_events_mutex);
+    *width = ng_window_width;
+    *height = ng_window_height;
+    pthread_mutex_unlock(&ng_events_mutex);
+    return 1;
+}
+
+void ng_get_keyboard(unsigned char* key, int* state)
+{
+    *key = ng_keyboard_key;
+    *state = ng_keyboard_state;
+    ng_keyboard_state = RELEASED;
+}
@@ -0,0 +1,232 @@
+#include "internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+/* every rectangle or line is one instance read straight from the caller's
+   array: the corners are converted by the vertex shader and the shared
+   unit geometry below is stretched over them; a wide line is a quad
+   along the segment, x running from x0, y0 to x1, y1, y across it and z
+   along it in half widths, which moves the ends of square caps out. A
+   round cap follows the butt quad as the fans of ng_line_round, made
+   at init */
+static const GLfloat ng_instanced_quads[] = {
+    0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,  1.0f, 0.0f, 0.0f,
+                                            // a rectangle as two triangles
+    0.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,    // a line from x0, y0 to x1, y1
+    0.0f, 1.0f, -1.0f,  0.0f, -1.0f, -1.0f,  1.0f, -1.0f, 1.0f,
+    0.0f, 1.0f, -1.0f,  1.0f, -1.0f, 1.0f,  1.0f, 1.0f, 1.0f,
+                                            // a square capped wide line
+    0.0f, 1.0f, 0.0f,  0.0f, -1.0f, 0.0f,  1.0f, -1.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,  1.0f, -1.0f, 0.0f,  1.0f, 1.0f, 0.0f
+                                            // a wide line cut at the ends
+};
+
+#define NG_INSTANCED_RECTANGLE_FIRST 0
+#define NG_INSTANCED_LINE_FIRST 6
+#define NG_INSTANCED_SQUARE_LINE_FIRST 8
+#define NG_INSTANCED_WIDE_LINE_FIRST 14
+#define NG_INSTANCED_ROUND_CAPS (2 * NG_ROUND_CAP_STEPS * 3)
+#define NG_INSTANCED_CORNERS (20 + NG_INSTANCED_ROUND_CAPS)
+
+/* 0xRRGGBBAA read as four bytes */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NG_INSTANCED_SWIZZLE "wzyx"
+#else
+#define NG_INSTANCED_SWIZZLE "xyzw"
+#endif
+
+static int ng_instanced_state;          // 0 untried, 1 ready, -1 unavailable
+static GLuint ng_instanced_program;
+static GLuint ng_instanced_corner_vbo;
+static GLuint ng_instanced_vbo;
+static GLuint ng_instanced_vao;
+static GLint ng_instanced_uniform_resolution;
+static GLint ng_instanced_uniform_half_width;
+static GLfloat ng_instanced_half_width;
+static int ng_instanced_width;
+static int ng_instanced_height;
+
+static void ng_instanced_attributes();
+static void ng_instanced_fill_corners(GLfloat* corners);
+
+int ng_instanced_init()
+{
+    static const char* vs_source =
+        "attribute vec3 corner;"
+        "attribute vec4 rect;"
+        "attribute vec4 color;"
+        "uniform vec2 resolution;"
+        "uniform float half_width;"
+        "varying vec4 f_color;"
+        "void main(void) {"
+        "  vec2 coord2d = mix(rect.xy, rect.zw, corner.xy);"
+        "  if (half_width > 0.0) {"
+        "    vec2 d = rect.zw - rect.xy;"
+        "    float len = length(d);"
+        "    vec2 n = len > 0.0 ? vec2(-d.y, d.x) * (half_width / len) : vec2(0.0);"
+        "    coord2d = mix(rect.xy, rect.zw, corner.x) + n * corner.y +"
+        "              vec2(n.y, -n.x) * corner.z;"
+        "  }"
+        "  vec2 coords = coord2d / resolution * 2.0 - vec2(1.0, 1.0);"
+        "  gl_Position = vec4(coords, 0.0, 1.0);"
+        "  f_color = color." NG_INSTANCED_SWIZZLE ";"
+        "}";
+    static const char* fs_source =
+        "varying vec4 f_color;"
+        "void main(void) {"
+        "  ng_frag_color = f_color;"
+        "}";
+    static const char* attributes[] = { "corner", "rect", "color" };
+    GLfloat corners[NG_INSTANCED_CORNERS * 3];
+
+    if (ng_instanced_state != 0)
+        return ng_instanced_state > 0;
+
+    ng_instanced_state = -1;
+    if (ng_backend != NG_BACKEND_GL33 && !GLEW_ARB_instanced_arrays)
+        return 0;
+
+    ng_instanced_program = ng_compile_program(vs_source, fs_source,
+                                              attributes, 3);
+    if (ng_instanced_program == 0)
+        return 0;
+    ng_instanced_uniform_resolution =
+        glGetUniformLocation(ng_instanced_program, "resolution");
+    ng_instanced_uniform_half_width =
+        glGetUniformLocation(ng_instanced_program, "half_width");
+
+    glGenBuffers(1, &ng_instanced_corner_vbo);
+    ng_gl_bind_buffer(GL_ARRAY_BUFFER, ng_instanced_corner_vbo);
+    ng_instanced_fill_corners(corners);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glGenBuffers(1, &ng_instanced_vbo);
+
+    // the core profile sets the layout up once in a vertex array
+    if (ng_backend == NG_BACKEND_GL33)
+    {
+        glGenVertexArrays(1, &ng_instanced_vao);
+        ng_gl_bind_vertex_array(ng_instanced_vao);
+        ng_instanced_attributes();
+    }
+
+    ng_instanced_state = 1;
+    return 1;
+}
+
+void ng_instanced_free()
+{
+    if (ng_instanced_state <= 0)
+        return;
+    if (ng_instanced_vao != 0)
+        ng_gl_delete_vertex_array(ng_instanced_vao);
+    ng_instanced_vao = 0;
+    ng_gl_delete_buffer(ng_instanced_vbo);
+    ng_gl_delete_buffer(ng_instanced_corner_vbo);
+    ng_gl_delete_program(ng_instanced_program);
+    ng_instanced_state = 0;
+    ng_instanced_width = 0;
+    ng_instanced_height = 0;
+    ng_instanced_half_width = 0.0f;
+}
+
+// items are ng_rect or ng_line, which share one layout
+void ng_instanced_draw(GLenum mode, const void* items, int count,
+                       GLfloat line_width)
+{
+    int width, height;
+    ng_get_window_size(&width, &height);
+
+    ng_gl_use_program(ng_instanced_program);
+    if (ng_instanced_width != width || ng_instanced_height != height)
+    {
+        glUniform2f(ng_instanced_uniform_resolution,
+                    (GLfloat)width, (GLfloat)height);
+        ng_instanced_width = width;
+        ng_instanced_height = height;
+    }
+
+    GLsizeiptr bytes = (GLsizeiptr)count * sizeof(ng_rect);
+    ng_gl_bind_buffer(GL_ARRAY_BUFFER, ng_instanced_vbo);
+    glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, items);
+    if (ng_backend == NG_BACKEND_GL33)
+        ng_gl_bind_vertex_array(ng_instanced_vao);
+    else
+        ng_instanced_attributes();
+
+    // lines wider than a pixel are quads, as in ng_draw_line
+    GLfloat half_width = mode == GL_LINES && line_width > 1.0f
+        ? line_width * 0.5f : 0.0f;
+    if (half_width != ng_instanced_half_width)
+    {
+        glUniform1f(ng_instanced_uniform_half_width, half_width);
+        ng_instanced_half_width = half_width;
+    }
+
+    GLenum primitive = GL_TRIANGLES;
+    int first = NG_INSTANCED_RECTANGLE_FIRST;
+    int vertices = 6;
+    if (half_width > 0.0f && ng_line_cap == NG_CAP_SQUARE)
+        first = NG_INSTANCED_SQUARE_LINE_FIRST;
+    else if (half_width > 0.0f)
+    {
+        first = NG_INSTANCED_WIDE_LINE_FIRST;
+        if (ng_line_cap == NG_CAP_ROUND)
+            vertices += NG_INSTANCED_ROUND_CAPS;
+    }
+    else if (mode == GL_LINES)
+    {
+        primitive = GL_LINES;
+        first = NG_INSTANCED_LINE_FIRST;
+        vertices = 2;
+        ng_gl_line_width(1.0f);
+    }
+    ng_profile_draw(NG_PIPELINE_INSTANCED, mode, line_width, count * vertices);
+    if (ng_backend == NG_BACKEND_GL33)
+        glDrawArraysInstanced(primitive, first, vertices, count);
+    else
+        glDrawArraysInstancedARB(primitive, first, vertices, count);
+}
+
+void ng_instanced_attributes()
+{
+    ng_gl_enable_attributes(1u << 0 | 1u << 1 | 1u << 2);  // corner, rect, color
+    ng_gl_bind_buffer(GL_ARRAY_BUFFER, ng_instanced_corner_vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    ng_gl_bind_buffer(GL_ARRAY_BUFFER, ng_instanced_vbo);
+    glVertexAttribPointer(1, 4, GL_INT, GL_FALSE, sizeof(ng_rect),
+                          (const GLvoid*)offsetof(ng_rect, x0));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ng_rect),
+                          (const GLvoid*)offsetof(ng_rect, color));
+    ng_gl_attribute_divisor(1, 1);
+    ng_gl_attribute_divisor(2, 1);
+}
+
+// the quads, then a fan of triangles around each end: the start's
+// behind x0, y0 and the end's past x1, y1
+void ng_instanced_fill_corners(GLfloat* corners)
+{
+    GLfloat* c = corners + sizeof(ng_instanced_quads) / sizeof(GLfloat);
+    int end, i;
+    memcpy(corners, ng_instanced_quads, sizeof(ng_instanced_quads));
+    for (end = 0; end < 2; ++end)
+    {
+        GLfloat forward = end == 0 ? -1.0f : 1.0f;
+        for (i = 0; i < NG_ROUND_CAP_STEPS; ++i)
+        {
+            GLfloat angle0 = NG_PI * i / NG_ROUND_CAP_STEPS;
+            GLfloat angle1 = NG_PI * (i + 1) / NG_ROUND_CAP_STEPS;
+            GLfloat fan[9] = {
+                (GLfloat)end, 0.0f, 0.0f,
+                (GLfloat)end, cosf(angle0), forward * sinf(angle0),
+                (GLfloat)end, cosf(angle1), forward * sinf(angle1),
+            };
+            memcpy(c, fan, sizeof(fan));
+            c += 9;
+        }
+    }
+}
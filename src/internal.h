@@ -0,0 +1,299 @@
+#ifndef NOOBGRAPHICS_INTERNAL_H
+#define NOOBGRAPHICS_INTERNAL_H
+
+#include <noobgraphics.h>
+#include <stddef.h>
+
+/* freeglut keeps its additions, core profile contexts and leaving the
+   main loop, out of GL/glut.h */
+#ifdef FREEGLUT
+#include <GL/freeglut_ext.h>
+#endif
+
+#define NG_FONT_WIDTH 9
+#define NG_FONT_HEIGHT 16
+#define NG_FONT_DESCENT 4
+#define NG_FONT_FIRST 32
+#define NG_FONT_GLYPHS 95
+
+/* glyphs sit in 16 columns of 9x16 cells, the top right corner is white */
+#define NG_FONT_ATLAS_WIDTH 256
+#define NG_FONT_ATLAS_HEIGHT 128
+#define NG_FONT_ATLAS_COLUMNS 16
+#define NG_FONT_WHITE_SIZE 8
+#define NG_WHITE_U (1.0f - NG_FONT_WHITE_SIZE * 0.5f / NG_FONT_ATLAS_WIDTH)
+#define NG_WHITE_V (1.0f - NG_FONT_WHITE_SIZE * 0.5f / NG_FONT_ATLAS_HEIGHT)
+
+/* a batch mode next to the GL primitives: four vertices per quad,
+   (x0, y0) (x0, y1) (x1, y1) (x1, y0) for a rectangle, drawn as the
+   triangles 0 1 2 and 0 2 3 */
+#define NG_QUADS 0x10000
+
+typedef struct
+{
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte color[4];
+} ng_vertex;
+
+typedef void (*ng_span_func)(GLubyte* p, int n, const GLubyte* color);
+
+typedef struct
+{
+    const char* name;
+    ng_span_func fill;
+    ng_span_func blend;
+} ng_span_kernels;
+
+/* two RGBA rows into two luma rows and one row of each chroma plane */
+typedef void (*ng_i420_func)(const unsigned char* row0,
+                             const unsigned char* row1, int width,
+                             unsigned char* y0, unsigned char* y1,
+                             unsigned char* u, unsigned char* v);
+
+typedef struct
+{
+    const char* name;
+    ng_i420_func rows;
+} ng_i420_kernels;
+
+extern const unsigned short ng_font_glyphs[NG_FONT_GLYPHS][NG_FONT_HEIGHT];
+void ng_font_bake(GLubyte* rgba);
+
+/* spans.c: kernels over n RGBA8 pixels, chosen at runtime */
+extern ng_span_func ng_span_fill;
+extern ng_span_func ng_span_blend;
+void ng_spans_init();
+const ng_span_kernels* ng_get_span_kernels(int* count);
+
+/* noobgraphics.c: vertices are drawn with an atlas page bound, solid
+   ones reserved with NG_ANY_PAGE keep whichever page is current */
+#define NG_ANY_PAGE -1
+extern int ng_backend;
+void ng_batch_flush();
+ng_vertex* ng_batch_reserve(GLenum mode, int vertices, GLfloat line_width,
+                            int page);
+// a vertex in the current color on the white texels of the atlas
+void ng_put_vertex(ng_vertex* v, GLfloat x, GLfloat y);
+void ng_draw_vertices(GLuint vbo, GLuint* vao, const ng_vertex* vertices,
+                      GLenum mode, int first, int count, GLfloat line_width,
+                      int page);
+GLuint ng_compile_program(const char* vs_source, const char* fs_source,
+                          const char* const* attributes, int count);
+int ng_get_update_rate();
+// the array, reallocated to twice its capacity (or 256 items) until
+// needed items fit; NULL when out of memory, the array is kept then
+void* ng_grow(void* array, int* capacity, int needed, size_t item);
+
+/* programs.c: linked programs cached on disk, keyed by the driver
+   strings and the sources */
+int ng_program_cache_available();
+unsigned long long ng_program_key(const char* const* vs_sources,
+                                  const char* const* fs_sources, int sources,
+                                  const char* const* attributes, int count);
+GLuint ng_program_cache_load(unsigned long long key);
+void ng_program_cache_save(unsigned long long key, GLuint program);
+
+/* glstate.c: GL state changes go through here and are skipped when
+   the shadowed value already matches */
+void ng_gl_use_program(GLuint program);
+void ng_gl_bind_texture(GLuint texture);
+void ng_gl_bind_buffer(GLenum target, GLuint buffer);
+void ng_gl_bind_vertex_array(GLuint vao);
+void ng_gl_enable_attributes(unsigned int mask);
+void ng_gl_attribute_divisor(GLuint index, GLuint divisor);
+void ng_gl_line_width(GLfloat width);
+void ng_gl_blend(int enabled, GLenum src, GLenum dst);
+void ng_gl_scissor(int enabled, GLint x, GLint y, GLsizei width, GLsizei height);
+void ng_gl_delete_buffer(GLuint buffer);
+void ng_gl_delete_texture(GLuint texture);
+void ng_gl_delete_program(GLuint program);
+void ng_gl_delete_vertex_array(GLuint vao);
+
+/* capture.c: frames asked for are read back at the end of the frame,
+   through a ring of pixel buffers on GL, and written or handed to the
+   callback on a capture thread; the logic thread's requests are held
+   until its command list is drawn */
+typedef struct ng_capture_job ng_capture_job;
+void ng_capture_read(int wait);
+void ng_capture_step();
+ng_capture_job* ng_capture_hold();
+void ng_capture_release(ng_capture_job* jobs);
+void ng_capture_free();
+
+/* y4m.c: the frames of ng_stream_y4m converted to I420 and written on
+   the capture thread, with kernels chosen at runtime */
+int ng_y4m_open(const char* path);
+int ng_y4m_write(int fd, int generation, const unsigned char* rgba,
+                 int width, int height, int bottom_up, int repeats);
+void ng_y4m_free();
+const ng_i420_kernels* ng_get_i420_kernels(int* count);
+
+/* commands.c: a thread recording a command list, or the logic thread
+   with a render thread, reserves its vertices in the list and the GLUT
+   thread draws the published lists */
+int ng_commands_start(void (*logic)());
+void ng_commands_free();
+int ng_commands_recording();
+int ng_commands_on_logic_thread();
+int ng_commands_stopping();
+ng_vertex* ng_commands_reserve(GLenum mode, int vertices, GLfloat line_width,
+                               int page);
+void ng_commands_draw(const ng_vertex* vertices, GLenum mode, int count,
+                      GLfloat line_width, int page);
+void ng_commands_publish(long long render_us);
+void ng_commands_idle();
+void ng_commands_display();
+
+/* egl.c: a surfaceless EGL context drawing into a framebuffer object,
+   for the GL backends without a window */
+int ng_egl_init(int width, int height);
+int ng_egl_init_framebuffer();
+void ng_egl_present();
+const unsigned char* ng_egl_get_pixels(int* width, int* height);
+void ng_egl_free();
+
+/* geometry.c: while a geometry is recorded the batch hands out its
+   vertices instead */
+int ng_geometry_recording();
+ng_vertex* ng_geometry_reserve(GLenum mode, int vertices, GLfloat line_width,
+                               int page);
+
+/* sprites.c: images are packed into atlas pages, page 0 is the font
+   atlas; every page is white where the font atlas is, so solid
+   primitives look the same whichever page is bound. Only ready images
+   have a place in a page. */
+#define NG_IMAGE_FAILED -1
+#define NG_IMAGE_LOADING 0
+#define NG_IMAGE_READY 1
+#define NG_IMAGE_CANCELLED 2
+
+struct ng_image
+{
+    int state;
+    int trace_id;           // 0 until a trace has its pixels
+    int trace_session;      // the recording that numbered it
+    int page;
+    int x, y;               // bottom left corner in the page
+    int width;
+    int height;
+};
+
+int ng_image_place(ng_image* image, const unsigned char* rgba, int width,
+                   int height);
+GLuint ng_page_texture(int page);
+const GLubyte* ng_page_pixels(int page, int* width, int* height);
+void ng_sprites_free();
+// the sprite scratch of the calling thread
+void ng_sprites_free_scratch();
+
+/* loader.c: files are decoded on a loader thread, and each frame
+   places a budget of the decoded images into pages */
+void ng_loader_poll();
+void ng_loader_free();
+unsigned char* ng_read_file(const char* path, size_t* size);
+
+/* trace.c: the public calls record themselves while ng_trace_recording
+   is set, which pausing clears so calls made on behalf of another one
+   aren't recorded twice; images and geometries are numbered from 1 in
+   the trace, 0 for the ones it doesn't have, and keep the session of
+   the recording that numbered them, as the numbers start again with
+   every recording */
+#define NG_TRACE_WINDOW 1
+#define NG_TRACE_FRAME 2
+#define NG_TRACE_COLOR 3
+#define NG_TRACE_LINE 4
+#define NG_TRACE_POLYLINE 5
+#define NG_TRACE_POINTS 6
+#define NG_TRACE_DECIMATION 7
+#define NG_TRACE_RECTANGLE 8
+#define NG_TRACE_TEXT 9
+#define NG_TRACE_RECTANGLES 10
+#define NG_TRACE_LINES 11
+#define NG_TRACE_IMAGE 12
+#define NG_TRACE_DRAW_IMAGE 13
+#define NG_TRACE_SPRITES 14
+#define NG_TRACE_FREE_IMAGE 15
+#define NG_TRACE_BEGIN_GEOMETRY 16
+#define NG_TRACE_GEOMETRY_MARK 17
+#define NG_TRACE_UPDATE_GEOMETRY 18
+#define NG_TRACE_END_GEOMETRY 19
+#define NG_TRACE_DRAW_GEOMETRY 20
+#define NG_TRACE_FREE_GEOMETRY 21
+#define NG_TRACE_LINE_CAP 22
+extern _Thread_local int ng_trace_recording;
+extern int ng_trace_replaying;
+extern int ng_trace_session;
+void ng_trace_ints(int op, int count, ...);
+// count items of fields ints each, after arg
+void ng_trace_array(int op, int arg, const void* items, int count, int fields);
+void ng_trace_text(int x, int y, const char* text);
+int ng_trace_image(const ng_image* image);
+void ng_trace_sprites(const ng_sprite* sprites, int count);
+int ng_trace_new_geometry();
+int ng_trace_id(int id, int session);
+void ng_trace_pause();
+void ng_trace_resume();
+void ng_trace_close();
+
+/* instanced.c: GL instanced drawing of ng_rect/ng_line arrays, init
+   returns 0 when instanced arrays are missing */
+int ng_instanced_init();
+void ng_instanced_free();
+void ng_instanced_draw(GLenum mode, const void* items, int count,
+                       GLfloat line_width);
+
+/* lines.c: the NG_CAP_* of wide lines; a round cap is a fan of this many
+   triangles, an even number, on the CPU and in the instanced shader
+   alike */
+#define NG_ROUND_CAP_STEPS 8
+#define NG_PI 3.14159265f
+extern int ng_line_cap;
+
+/* profiler.c: the draw calls of one pipeline with the same primitive
+   type and line width don't change state */
+#define NG_PIPELINE_BATCH 0
+#define NG_PIPELINE_INSTANCED 1
+#define NG_PIPELINE_TEXT 2
+void ng_profile_init();
+void ng_profile_update(long long us);
+int ng_profile_is_paused();
+void ng_profile_set_paused(int paused);
+void ng_profile_draw(int pipeline, GLenum mode, GLfloat line_width,
+                     int vertices);
+void ng_profile_gl_call(int avoided);
+void ng_profile_end_frame(long long render_us, long long swap_us);
+void ng_profile_draw_overlay();
+
+/* input.c */
+#define NG_EVENT_QUEUE_SIZE 1024
+void ng_input_push(const ng_event* event);
+void ng_input_feed();
+/* publishes the window size to ng_get_window_size */
+void ng_input_resize(int width, int height);
+
+/* plot.c: min/max per pixel column decimation; returns the number of
+   points to draw, *result is points itself when it is off */
+int ng_decimate_polyline(const ng_point* points, int count,
+                         const ng_point** result);
+void ng_plot_free();
+
+/* threads.c: work-stealing pool, threads <= 0 means one per core */
+typedef void (*ng_task_func)(int task, void* ctx);
+int ng_pool_init(int threads);
+void ng_pool_free();
+int ng_pool_threads_count();
+void ng_pool_run(int tasks, ng_task_func func, void* ctx);
+
+/* software.c: RGBA8 framebuffer, row 0 is the top of the window;
+   more than one thread switches to tile-binned rasterization */
+int ng_soft_init(int width, int height, int threads);
+void ng_soft_free();
+void ng_soft_clear();
+void ng_soft_draw(GLenum mode, const ng_vertex* v, int count, GLfloat line_width,
+                  int page);
+void ng_soft_draw_text(int x, int y, const char* text, const GLubyte* color);
+void ng_soft_present();
+unsigned char* ng_soft_get_pixels(int* width, int* height);
+
+#endif
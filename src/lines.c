@@ -0,0 +1,305 @@
+#include "internal.h"
+#include <stddef.h>
+#include <math.h>
+
+/* lines wider than a pixel are quads around the segment instead of wide
+   GL lines, which drivers may clamp; the ends are cut at the end points,
+   moved out by half the width for square caps or closed by a half disc
+   for round ones, and polyline joins are mitered, or beveled where the
+   miter would reach further than NG_MITER_LIMIT half widths; a bevel
+   shares the corner where the inner edges cross with both quads, so the
+   join covers every pixel once unless the segments are too short to
+   reach it */
+#define NG_MITER_LIMIT 4.0f
+
+typedef struct
+{
+    GLfloat x, y;
+} ng_vec2;
+
+static int ng_line_normal(ng_vec2 a, ng_vec2 b, GLfloat half_width,
+                          ng_vec2* normal);
+static void ng_line_quad(ng_vec2 left0, ng_vec2 right0, ng_vec2 right1,
+                         ng_vec2 left1);
+static void ng_line_bevel(ng_vec2 inner, ng_vec2 outer0, ng_vec2 outer1);
+static void ng_line_round(ng_vec2 p, ng_vec2 normal, GLfloat forward);
+static ng_vec2 ng_line_forward(ng_vec2 normal);
+static ng_vec2 ng_point_vec2(const ng_point* p);
+static ng_vec2 ng_offset(ng_vec2 p, ng_vec2 offset, GLfloat scale);
+static GLfloat ng_dot(ng_vec2 a, ng_vec2 b);
+
+int ng_line_cap;
+
+void ng_set_line_cap(int cap)
+{
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_LINE_CAP, 1, cap);
+    ng_line_cap = cap;
+}
+
+void ng_draw_line(int x0, int y0, int x1, int y1, int width)
+{
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_LINE, 5, x0, y0, x1, y1, width);
+    if (width <= 1)
+    {
+        ng_vertex* v = ng_batch_reserve(GL_LINES, 2, 1.0f, NG_ANY_PAGE);
+        if (v == NULL)
+            return;
+
+        ng_put_vertex(v, (GLfloat)x0, (GLfloat)y0);
+        ng_put_vertex(v+1, (GLfloat)x1, (GLfloat)y1);
+        return;
+    }
+
+    ng_vec2 a = { (GLfloat)x0, (GLfloat)y0 };
+    ng_vec2 b = { (GLfloat)x1, (GLfloat)y1 };
+    ng_vec2 n;
+    if (!ng_line_normal(a, b, width * 0.5f, &n))
+        return;
+    if (ng_line_cap == NG_CAP_SQUARE)
+    {
+        a = ng_offset(a, ng_line_forward(n), -1.0f);
+        b = ng_offset(b, ng_line_forward(n), 1.0f);
+    }
+    ng_line_quad(ng_offset(a, n, 1.0f), ng_offset(a, n, -1.0f),
+                 ng_offset(b, n, -1.0f), ng_offset(b, n, 1.0f));
+    if (ng_line_cap == NG_CAP_ROUND)
+    {
+        ng_line_round(a, n, -1.0f);
+        ng_line_round(b, n, 1.0f);
+    }
+}
+
+// repeated points are skipped; a join's miter is shared by the quads on
+// both sides, so they meet without overlapping
+void ng_draw_polyline(const ng_point* points, int count, int width)
+{
+    int i;
+    if (ng_trace_recording)
+        ng_trace_array(NG_TRACE_POLYLINE, width, points, count, 2);
+    count = ng_decimate_polyline(points, count, &points);
+    if (count < 2)
+        return;
+
+    if (width <= 1)
+    {
+        for (i = 0; i + 1 < count; ++i)
+        {
+            ng_vertex* v = ng_batch_reserve(GL_LINES, 2, 1.0f, NG_ANY_PAGE);
+            if (v == NULL)
+                return;
+
+            ng_put_vertex(v, (GLfloat)points[i].x, (GLfloat)points[i].y);
+            ng_put_vertex(v+1, (GLfloat)points[i+1].x, (GLfloat)points[i+1].y);
+        }
+        return;
+    }
+
+    const GLfloat half_width = width * 0.5f;
+    const GLfloat min_miter = 2.0f / (NG_MITER_LIMIT * NG_MITER_LIMIT);
+    ng_vec2 start = ng_point_vec2(&points[0]);
+    ng_vec2 start_left = start, start_right = start;
+    ng_vec2 last = start;
+    ng_vec2 last_normal = { 0.0f, 0.0f };
+    ng_vec2 first = start;
+    ng_vec2 first_normal = { 0.0f, 0.0f };
+    // how far the start's inner corner was moved along the segment, and
+    // its side, 1 left and -1 right
+    GLfloat start_pull = 0.0f;
+    GLfloat start_side = 0.0f;
+    int segments = 0;
+
+    for (i = 1; i < count; ++i)
+    {
+        ng_vec2 p = ng_point_vec2(&points[i]);
+        ng_vec2 n;
+        if (!ng_line_normal(last, p, half_width, &n))
+            continue;
+
+        if (segments++ == 0)
+        {
+            ng_vec2 end = last;
+            if (ng_line_cap == NG_CAP_SQUARE)
+                end = ng_offset(last, ng_line_forward(n), -1.0f);
+            start_left = ng_offset(end, n, 1.0f);
+            start_right = ng_offset(end, n, -1.0f);
+            first = last;
+            first_normal = n;
+            last = p;
+            last_normal = n;
+            continue;
+        }
+
+        // the miter is (n0 + n1) / s, s = 1 + cos of the turn, and
+        // reaches sqrt(2 / s) half widths from the join; the outer side
+        // of the turn is 1 left of the segments and -1 right
+        ng_vec2 m = { last_normal.x + n.x, last_normal.y + n.y };
+        GLfloat s = (m.x * m.x + m.y * m.y) /
+                    (2.0f * half_width * half_width);
+        GLfloat side = last_normal.x * n.y - last_normal.y * n.x > 0.0f
+            ? -1.0f : 1.0f;
+        ng_vec2 to_start = { start.x - last.x, start.y - last.y };
+        ng_vec2 to_next = { p.x - last.x, p.y - last.y };
+        GLfloat length0 = sqrtf(ng_dot(to_start, to_start));
+        GLfloat length1 = sqrtf(ng_dot(to_next, to_next));
+        ng_vec2 miter = { 0.0f, 0.0f };
+        GLfloat pull0 = 0.0f, pull1 = 0.0f;
+        if (s > 0.0f)
+        {
+            miter.x = m.x / s;
+            miter.y = m.y / s;
+            // the inner corner is where the inner edges cross, this far
+            // back along each segment
+            pull0 = -side * ng_dot(miter, to_start) / length0;
+            pull1 = -side * ng_dot(miter, to_next) / length1;
+        }
+        if (start_side == -side)
+            pull0 += start_pull;
+
+        if (s >= min_miter)
+        {
+            ng_line_quad(start_left, start_right, ng_offset(last, miter, -1.0f),
+                         ng_offset(last, miter, 1.0f));
+            start_left = ng_offset(last, miter, 1.0f);
+            start_right = ng_offset(last, miter, -1.0f);
+            start_pull = pull1;
+            start_side = -side;
+        }
+        else
+        {
+            // a bevel from the inner corner while the segments reach it,
+            // otherwise from the join, where they overlap
+            ng_vec2 outer0 = ng_offset(last, last_normal, side);
+            ng_vec2 outer1 = ng_offset(last, n, side);
+            ng_vec2 inner = last;
+            ng_vec2 inner0 = ng_offset(last, last_normal, -side);
+            ng_vec2 inner1 = ng_offset(last, n, -side);
+            start_pull = 0.0f;
+            start_side = 0.0f;
+            if (s > 0.0f && pull0 <= length0 && pull1 <= length1)
+            {
+                inner = ng_offset(last, miter, -side);
+                inner0 = inner;
+                inner1 = inner;
+                start_pull = pull1;
+                start_side = -side;
+            }
+
+            if (side > 0.0f)
+            {
+                ng_line_quad(start_left, start_right, inner0, outer0);
+                start_left = outer1;
+                start_right = inner1;
+            }
+            else
+            {
+                ng_line_quad(start_left, start_right, outer0, inner0);
+                start_left = inner1;
+                start_right = outer1;
+            }
+            ng_line_bevel(inner, outer0, outer1);
+        }
+        start = last;
+        last = p;
+        last_normal = n;
+    }
+
+    if (segments == 0)
+        return;
+    ng_vec2 end = last;
+    if (ng_line_cap == NG_CAP_SQUARE)
+        end = ng_offset(last, ng_line_forward(last_normal), 1.0f);
+    ng_line_quad(start_left, start_right, ng_offset(end, last_normal, -1.0f),
+                 ng_offset(end, last_normal, 1.0f));
+    if (ng_line_cap == NG_CAP_ROUND)
+    {
+        ng_line_round(first, first_normal, -1.0f);
+        ng_line_round(last, last_normal, 1.0f);
+    }
+}
+
+// the normal points left of a to b and is half_width long; a segment
+// without length has none
+int ng_line_normal(ng_vec2 a, ng_vec2 b, GLfloat half_width, ng_vec2* normal)
+{
+    GLfloat dx = b.x - a.x;
+    GLfloat dy = b.y - a.y;
+    GLfloat length = sqrtf(dx * dx + dy * dy);
+    if (length == 0.0f)
+        return 0;
+
+    normal->x = -dy * (half_width / length);
+    normal->y = dx * (half_width / length);
+    return 1;
+}
+
+// the corners left and right of both ends, in the order of
+// ng_draw_rectangle, so an axis-aligned line is a rectangle to the
+// software backend
+void ng_line_quad(ng_vec2 left0, ng_vec2 right0, ng_vec2 right1, ng_vec2 left1)
+{
+    ng_vertex* v = ng_batch_reserve(NG_QUADS, 4, 1.0f, NG_ANY_PAGE);
+    if (v == NULL)
+        return;
+
+    ng_put_vertex(v,   left0.x, left0.y);
+    ng_put_vertex(v+1, right0.x, right0.y);
+    ng_put_vertex(v+2, right1.x, right1.y);
+    ng_put_vertex(v+3, left1.x, left1.y);
+}
+
+// fills the notch on the outer side of a sharp turn with a triangle,
+// a quad with its last corner repeated
+void ng_line_bevel(ng_vec2 inner, ng_vec2 outer0, ng_vec2 outer1)
+{
+    ng_vertex* v = ng_batch_reserve(NG_QUADS, 4, 1.0f, NG_ANY_PAGE);
+    if (v == NULL)
+        return;
+
+    ng_put_vertex(v,   inner.x, inner.y);
+    ng_put_vertex(v+1, outer0.x, outer0.y);
+    ng_put_vertex(v+2, outer1.x, outer1.y);
+    ng_put_vertex(v+3, outer1.x, outer1.y);
+}
+
+// a half disc on the end at p, past it when forward is 1 and before it
+// when -1, as a fan from p with two triangles to a quad
+void ng_line_round(ng_vec2 p, ng_vec2 normal, GLfloat forward)
+{
+    ng_vec2 along = ng_line_forward(normal);
+    ng_vec2 arc[NG_ROUND_CAP_STEPS + 1];
+    int i;
+    for (i = 0; i <= NG_ROUND_CAP_STEPS; ++i)
+    {
+        GLfloat angle = NG_PI * i / NG_ROUND_CAP_STEPS;
+        arc[i] = ng_offset(ng_offset(p, normal, cosf(angle)), along,
+                           forward * sinf(angle));
+    }
+    for (i = 0; i < NG_ROUND_CAP_STEPS; i += 2)
+        ng_line_quad(p, arc[i], arc[i + 1], arc[i + 2]);
+}
+
+// the direction of the line, as long as its normal
+ng_vec2 ng_line_forward(ng_vec2 normal)
+{
+    ng_vec2 v = { normal.y, -normal.x };
+    return v;
+}
+
+ng_vec2 ng_point_vec2(const ng_point* p)
+{
+    ng_vec2 v = { (GLfloat)p->x, (GLfloat)p->y };
+    return v;
+}
+
+ng_vec2 ng_offset(ng_vec2 p, ng_vec2 offset, GLfloat scale)
+{
+    ng_vec2 v = { p.x + scale * offset.x, p.y + scale * offset.y };
+    return v;
+}
+
+GLfloat ng_dot(ng_vec2 a, ng_vec2 b)
+{
+    return a.x * b.x + a.y * b.y;
+}
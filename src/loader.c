@@ -0,0 +1,413 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+/* one thread reads and decodes the files in the order they were asked
+   for and queues the pixels; every frame takes at most
+   NG_LOADER_FRAME_BYTES of them into the pages, so a burst of loads is
+   spread over a few frames instead of stalling one */
+#define NG_LOADER_FRAME_BYTES (4 << 20)
+#define NG_LOADER_MAX_SIZE 16384
+
+typedef struct ng_load
+{
+    ng_image* image;
+    char* path;
+    unsigned char* pixels;
+    int width;
+    int height;
+    struct ng_load* next;
+} ng_load;
+
+typedef struct
+{
+    ng_load* head;
+    ng_load* tail;
+} ng_load_queue;
+
+static void* ng_loader_main(void* arg);
+static void ng_load_push(ng_load_queue* queue, ng_load* load);
+static ng_load* ng_load_pop(ng_load_queue* queue);
+static void ng_load_finish(ng_load* load);
+static unsigned char* ng_decode_ppm(const unsigned char* data, size_t size,
+                                    int* width, int* height);
+static unsigned char* ng_decode_qoi(const unsigned char* data, size_t size,
+                                    int* width, int* height);
+static int ng_ppm_number(const unsigned char* data, size_t size, size_t* pos,
+                         int* value);
+static unsigned int ng_qoi_u32(const unsigned char* p);
+
+static pthread_t ng_loader_thread;
+static int ng_loader_running;
+static int ng_loader_stop;
+static pthread_mutex_t ng_loader_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ng_loader_wake = PTHREAD_COND_INITIALIZER;
+static ng_load_queue ng_loader_requests;
+static ng_load_queue ng_loader_done;
+
+// the thread starts with the first load
+ng_image* ng_load_image(const char* path)
+{
+    if (path == NULL)
+        return NULL;
+
+    ng_image* image = malloc(sizeof(ng_image));
+    ng_load* load = calloc(1, sizeof(ng_load));
+    char* copy = malloc(strlen(path) + 1);
+    if (image == NULL || load == NULL || copy == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        free(image);
+        free(load);
+        free(copy);
+        return NULL;
+    }
+    strcpy(copy, path);
+    image->state = NG_IMAGE_LOADING;
+    image->trace_id = 0;
+    load->image = image;
+    load->path = copy;
+
+    pthread_mutex_lock(&ng_loader_mutex);
+    if (!ng_loader_running)
+    {
+        ng_loader_stop = 0;
+        if (pthread_create(&ng_loader_thread, NULL, ng_loader_main, NULL) != 0)
+        {
+            pthread_mutex_unlock(&ng_loader_mutex);
+            fprintf(stderr, "pthread_create failed\n");
+            free(image);
+            free(load);
+            free(copy);
+            return NULL;
+        }
+        ng_loader_running = 1;
+    }
+    ng_load_push(&ng_loader_requests, load);
+    pthread_cond_signal(&ng_loader_wake);
+    pthread_mutex_unlock(&ng_loader_mutex);
+    return image;
+}
+
+// the image states are the values returned
+int ng_image_ready(const ng_image* image)
+{
+    return image != NULL ? image->state : NG_IMAGE_FAILED;
+}
+
+// at least one image is taken however large it is; on the GL backends
+// without a render thread the pages are uploaded here rather than at
+// their first draw
+void ng_loader_poll()
+{
+    size_t bytes = 0;
+    if (!ng_loader_running)
+        return;
+
+    while (bytes < NG_LOADER_FRAME_BYTES)
+    {
+        pthread_mutex_lock(&ng_loader_mutex);
+        ng_load* load = ng_load_pop(&ng_loader_done);
+        pthread_mutex_unlock(&ng_loader_mutex);
+        if (load == NULL)
+            break;
+
+        bytes += (size_t)load->width * load->height * 4;
+        ng_load_finish(load);
+    }
+}
+
+// loads that haven't been taken yet fail
+void ng_loader_free()
+{
+    if (!ng_loader_running)
+        return;
+
+    pthread_mutex_lock(&ng_loader_mutex);
+    ng_loader_stop = 1;
+    pthread_cond_signal(&ng_loader_wake);
+    pthread_mutex_unlock(&ng_loader_mutex);
+    pthread_join(ng_loader_thread, NULL);
+    ng_loader_running = 0;
+
+    ng_load* load;
+    while ((load = ng_load_pop(&ng_loader_requests)) != NULL ||
+           (load = ng_load_pop(&ng_loader_done)) != NULL)
+    {
+        free(load->pixels);
+        load->pixels = NULL;
+        ng_load_finish(load);
+    }
+}
+
+void* ng_loader_main(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&ng_loader_mutex);
+    while (!ng_loader_stop)
+    {
+        ng_load* load = ng_load_pop(&ng_loader_requests);
+        if (load == NULL)
+        {
+            pthread_cond_wait(&ng_loader_wake, &ng_loader_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&ng_loader_mutex);
+
+        size_t size;
+        unsigned char* data = ng_read_file(load->path, &size);
+        if (data != NULL)
+        {
+            if (size >= 4 && memcmp(data, "qoif", 4) == 0)
+                load->pixels = ng_decode_qoi(data, size, &load->width,
+                                             &load->height);
+            else
+                load->pixels = ng_decode_ppm(data, size, &load->width,
+                                             &load->height);
+            if (load->pixels == NULL)
+                fprintf(stderr, "ng_load_image: %s isn't a PPM or QOI image\n",
+                        load->path);
+            free(data);
+        }
+
+        pthread_mutex_lock(&ng_loader_mutex);
+        ng_load_push(&ng_loader_done, load);
+    }
+    pthread_mutex_unlock(&ng_loader_mutex);
+    return NULL;
+}
+
+void ng_load_push(ng_load_queue* queue, ng_load* load)
+{
+    load->next = NULL;
+    if (queue->tail != NULL)
+        queue->tail->next = load;
+    else
+        queue->head = load;
+    queue->tail = load;
+}
+
+ng_load* ng_load_pop(ng_load_queue* queue)
+{
+    ng_load* load = queue->head;
+    if (load != NULL)
+    {
+        queue->head = load->next;
+        if (queue->head == NULL)
+            queue->tail = NULL;
+    }
+    return load;
+}
+
+// an image freed while it was loading is only freed now
+void ng_load_finish(ng_load* load)
+{
+    ng_image* image = load->image;
+    if (image->state == NG_IMAGE_CANCELLED)
+        free(image);
+    else if (load->pixels == NULL ||
+             !ng_image_place(image, load->pixels, load->width, load->height))
+        image->state = NG_IMAGE_FAILED;
+    else if (ng_backend != NG_BACKEND_SOFTWARE && !ng_commands_recording())
+        ng_page_texture(image->page);
+
+    free(load->pixels);
+    free(load->path);
+    free(load);
+}
+
+// the whole file, also for traces
+unsigned char* ng_read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "can't open %s\n", path);
+        return NULL;
+    }
+
+    unsigned char* data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        length = ftell(file);
+    if (length >= 0 && fseek(file, 0, SEEK_SET) == 0)
+        data = malloc(length > 0 ? (size_t)length : 1);
+    if (data != NULL && fread(data, 1, (size_t)length, file) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+    if (data == NULL)
+        fprintf(stderr, "can't read %s\n", path);
+
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+// binary P6 with 8 or 16 bit samples, scaled to 0..255
+unsigned char* ng_decode_ppm(const unsigned char* data, size_t size,
+                             int* width, int* height)
+{
+    size_t pos = 2;
+    int maxval;
+    if (size < 2 || data[0] != 'P' || data[1] != '6' ||
+        !ng_ppm_number(data, size, &pos, width) ||
+        !ng_ppm_number(data, size, &pos, height) ||
+        !ng_ppm_number(data, size, &pos, &maxval) ||
+        pos >= size || !isspace(data[pos]))
+        return NULL;
+    ++pos;
+
+    int bytes = maxval > 255 ? 2 : 1;
+    size_t count = (size_t)*width * *height;
+    if (*width <= 0 || *height <= 0 || *width > NG_LOADER_MAX_SIZE ||
+        *height > NG_LOADER_MAX_SIZE || maxval <= 0 || maxval > 65535 ||
+        (size - pos) / 3 / bytes < count)
+        return NULL;
+
+    unsigned char* rgba = malloc(count * 4);
+    if (rgba == NULL)
+        return NULL;
+
+    const unsigned char* p = data + pos;
+    size_t i;
+    int k;
+    for (i = 0; i < count; ++i)
+    {
+        for (k = 0; k < 3; ++k, p += bytes)
+        {
+            unsigned int v = bytes == 2 ? p[0] << 8 | p[1] : p[0];
+            if (v > (unsigned int)maxval)
+                v = maxval;
+            rgba[i * 4 + k] = maxval == 255 ? (unsigned char)v
+                : (unsigned char)((v * 255 + maxval / 2) / maxval);
+        }
+        rgba[i * 4 + 3] = 255;
+    }
+    return rgba;
+}
+
+// the next number of a PPM header, after whitespace and comments
+int ng_ppm_number(const unsigned char* data, size_t size, size_t* pos,
+                  int* value)
+{
+    while (*pos < size && (isspace(data[*pos]) || data[*pos] == '#'))
+    {
+        if (data[*pos] == '#')
+        {
+            while (*pos < size && data[*pos] != '\n')
+                ++*pos;
+        }
+        else
+        {
+            ++*pos;
+        }
+    }
+    if (*pos >= size || !isdigit(data[*pos]))
+        return 0;
+
+    int v = 0;
+    for (; *pos < size && isdigit(data[*pos]); ++*pos)
+    {
+        if (v > 1 << 24)
+            return 0;
+        v = v * 10 + (data[*pos] - '0');
+    }
+    *value = v;
+    return 1;
+}
+
+// the Quite OK Image format: every pixel is a run of the previous one, an
+// entry of a 64 color hash table, a small difference from the previous
+// one or a literal; the stream ends with seven zeros and a one
+unsigned char* ng_decode_qoi(const unsigned char* data, size_t size,
+                             int* width, int* height)
+{
+    if (size < 14 + 8)
+        return NULL;
+    unsigned int w = ng_qoi_u32(data + 4);
+    unsigned int h = ng_qoi_u32(data + 8);
+    if (w == 0 || h == 0 || w > NG_LOADER_MAX_SIZE || h > NG_LOADER_MAX_SIZE ||
+        data[12] < 3 || data[12] > 4)
+        return NULL;
+
+    size_t count = (size_t)w * h;
+    unsigned char* rgba = malloc(count * 4);
+    if (rgba == NULL)
+        return NULL;
+
+    unsigned char index[64][4];
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    memset(index, 0, sizeof(index));
+    size_t end = size - 8;
+    size_t p = 14;
+    int run = 0;
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (run > 0)
+        {
+            --run;
+        }
+        else
+        {
+            if (p >= end)
+                break;
+            unsigned char b = data[p++];
+            if (b == 0xFE || b == 0xFF)
+            {
+                int n = b == 0xFE ? 3 : 4;
+                if (p + n > end)
+                    break;
+                memcpy(px, data + p, n);
+                p += n;
+            }
+            else if ((b & 0xC0) == 0x00)
+            {
+                memcpy(px, index[b], 4);
+            }
+            else if ((b & 0xC0) == 0x40)
+            {
+                px[0] += ((b >> 4) & 3) - 2;
+                px[1] += ((b >> 2) & 3) - 2;
+                px[2] += (b & 3) - 2;
+            }
+            else if ((b & 0xC0) == 0x80)
+            {
+                if (p >= end)
+                    break;
+                int dg = (b & 0x3F) - 32;
+                unsigned char b2 = data[p++];
+                px[0] += dg - 8 + (b2 >> 4);
+                px[1] += dg;
+                px[2] += dg - 8 + (b2 & 0x0F);
+            }
+            else
+            {
+                run = b & 0x3F;
+            }
+            memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64],
+                   px, 4);
+        }
+        memcpy(rgba + i * 4, px, 4);
+    }
+
+    if (i < count)
+    {
+        free(rgba);
+        return NULL;
+    }
+    *width = (int)w;
+    *height = (int)h;
+    return rgba;
+}
+
+unsigned int ng_qoi_u32(const unsigned char* p)
+{
+    return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
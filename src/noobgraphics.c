@@ -1,36 +1,102 @@
-#include <noobgraphics.h>
+#include "internal.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <errno.h>
 
 static void ng_on_mouse_input(int button, int state, int x, int y);
 static void ng_on_mouse_move(int x, int y);
 static void ng_on_keyboard_press(unsigned char key, int x, int y);
 static void ng_on_keyboard_release(unsigned char key, int x, int y);
+static void ng_push_event(int type, int x, int y, int button, int state,
+                          unsigned char key);
 static void (*ng_on_update_dt)(int dt);
-static void ng_on_update();
+static void ng_on_timer(int value);
+static void ng_run_updates(long long now);
+static void ng_run_update();
+static int ng_next_step_dt();
+static void ng_sleep_until(long long time_us);
 static void (*ng_on_render)();
 static void ng_on_clear_and_render();
 static void ng_on_reshape(int width, int height);
 static int ng_init_resources();
 static void ng_free_resources();
 static void ng_log_shader(const char* tag, GLuint i);
-static void ng_convert_color(unsigned int rgba_color,
-                             GLfloat* r, GLfloat* g, GLfloat* b, GLfloat* a);
-
-static int ng_mouse_x;
-static int ng_mouse_y;
-static int ng_mouse_button;
-static int ng_mouse_state;
-static unsigned char ng_keyboard_key;
-static int ng_keyboard_state;
-static unsigned int ng_rgba_color;
-static int ng_dt;
+static int ng_init_batch();
+static int ng_init_font_texture();
+static void ng_run_headless();
+static void ng_init_software(int width, int height);
+static void ng_init_surfaceless(int width, int height);
+static void ng_run_frame();
+static void ng_run_logic();
+static void ng_free_headless();
+static void ng_vertex_attributes(GLuint vbo, int first);
+static int ng_reserve_quad_indices(int quads);
+static int ng_bulk_instanced();
+
+/* the color to go back to after drawing in other colors; it is put
+   back as it was, so no color value has to stand for "nothing saved" */
+typedef struct
+{
+    unsigned int rgba;
+    GLubyte packed[4];
+} ng_saved_color;
+
+static void ng_save_color(ng_saved_color* saved);
+static void ng_restore_color(const ng_saved_color* saved);
+
+#define NG_BATCH_INITIAL_CAPACITY 1024
+#define NG_DEFAULT_UPDATE_RATE 60
+#define NG_MAX_CATCHUP_STEPS 5
+
+int ng_backend = -1;
+static int ng_frame_limit;
+static int ng_threads = -1;     // -1 until set, then NG_THREADS or 1
+static int ng_render_thread = -1;
+static int ng_headless = -1;
+static int ng_redraw_requested;
+static int ng_quit_requested;
+// every thread draws in a color of its own
+static _Thread_local unsigned int ng_rgba_color;
+static int ng_update_rate = NG_DEFAULT_UPDATE_RATE;
+
+/* fixed timestep: the accumulator collects real time and every full
+   step runs the update callback once; the step is passed as whole
+   milliseconds and the remainder is carried into the next dt */
+static long long ng_step_us;
+static long long ng_last_time_us;
+static long long ng_accumulator_us;
+static long long ng_dt_carry_us;
 static int ng_window_width;
 static int ng_window_height;
 static GLuint ng_program;
 static GLint ng_attribute_coord2d;
-static GLint ng_uniform_color;
+static GLint ng_attribute_color;
+static GLint ng_attribute_texcoord;
+static GLint ng_uniform_resolution;
+static GLint ng_uniform_atlas;
+static int ng_program_width;
+static int ng_program_height;
+static GLuint ng_font_texture;
+static _Thread_local GLubyte ng_packed_color[4];
+
+/* primitives are collected here and submitted with one glDrawArrays
+   per primitive type change or frame */
+static GLuint ng_batch_vbo;
+static GLuint ng_batch_vao;
+static ng_vertex* ng_batch_vertices;
+static int ng_batch_size;
+static int ng_batch_capacity;
+static GLenum ng_batch_mode;
+static GLfloat ng_batch_line_width;
+static int ng_batch_page;
+
+/* rectangles and glyphs are batched as NG_QUADS, four vertices each,
+   and drawn as indexed triangles from this shared element buffer */
+static GLuint ng_quad_indices;
+static int ng_quad_indices_count;
 
 void ng_init_graphics(int width,
                       int height,
@@ -41,28 +107,91 @@ void ng_init_graphics(int width,
     int argc = 0;
     char** argv = NULL;
 
-    ng_mouse_x = 0;
-    ng_mouse_y = 0;
-    ng_mouse_button = 0;
-    ng_mouse_state = RELEASED;
-    ng_keyboard_key = 0;
-    ng_keyboard_state = RELEASED;
-    ng_rgba_color = -1;
-    ng_dt = 0;
+    // the cached value and the packed bytes have to agree, or the first
+    // ng_set_color of the cached value is skipped
+    ng_rgba_color = 0;
+    memset(ng_packed_color, 0, sizeof(ng_packed_color));
+    ng_step_us = 1000000 / (ng_update_rate > 0 ? ng_update_rate
+                                               : NG_DEFAULT_UPDATE_RATE);
+    ng_accumulator_us = 0;
+    ng_dt_carry_us = 0;
+    ng_batch_size = 0;
+    ng_batch_mode = GL_TRIANGLES;
+    ng_batch_line_width = 1.0f;
     ng_window_width = width;
     ng_window_height = height;
+    ng_input_resize(width, height);
+    ng_on_update_dt = update_func;
+    ng_on_render = render_func;
+
+    if (ng_backend < 0)
+    {
+        const char* env = getenv("NG_BACKEND");
+        if (env != NULL && strcmp(env, "software") == 0)
+            ng_backend = NG_BACKEND_SOFTWARE;
+        else if (env != NULL && strcmp(env, "gl33") == 0)
+            ng_backend = NG_BACKEND_GL33;
+        else
+            ng_backend = NG_BACKEND_OPENGL;
+    }
+    if (ng_frame_limit == 0 && getenv("NG_FRAMES") != NULL)
+        ng_frame_limit = atoi(getenv("NG_FRAMES"));
+    if (ng_threads < 0)
+        ng_threads = getenv("NG_THREADS") != NULL ? atoi(getenv("NG_THREADS"))
+                                                  : 1;
+    if (ng_render_thread < 0)
+        ng_render_thread = getenv("NG_RENDER_THREAD") != NULL
+            ? atoi(getenv("NG_RENDER_THREAD")) : 0;
+    if (ng_headless < 0)
+        ng_headless = getenv("NG_HEADLESS") != NULL
+            ? atoi(getenv("NG_HEADLESS")) : 0;
+    if (getenv("NG_TRACE") != NULL && !ng_trace_recording)
+        ng_record_trace(getenv("NG_TRACE"));
+    if (getenv("NG_Y4M") != NULL &&
+        !ng_stream_y4m(ng_y4m_open(getenv("NG_Y4M"))))
+        fprintf(stderr, "NG_Y4M is set, but nothing is streamed\n");
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_WINDOW, 2, width, height);
+    ng_profile_init();
+
+    if (ng_backend == NG_BACKEND_SOFTWARE)
+    {
+        ng_init_software(width, height);
+        return;
+    }
+    if (ng_headless)
+    {
+        ng_init_surfaceless(width, height);
+        return;
+    }
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_ALPHA);
     glutInitWindowSize(width, height);
+#ifdef GLUT_CORE_PROFILE
+    if (ng_backend == NG_BACKEND_GL33)
+    {
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+    }
+#else
+    ng_backend = NG_BACKEND_OPENGL;
+#endif
     glutCreateWindow(title);
 
+    // core profiles don't list their functions as extensions
+    glewExperimental = GL_TRUE;
     GLenum glew_status = glewInit();
     if (glew_status != GLEW_OK)
     {
         fprintf(stderr, "Error: %s\n", glewGetErrorString(glew_status));
         return;
     }
+    if (ng_backend == NG_BACKEND_GL33 && !GLEW_VERSION_3_3)
+    {
+        fprintf(stderr, "OpenGL 3.3 isn't available, using OpenGL 2.0\n");
+        ng_backend = NG_BACKEND_OPENGL;
+    }
 
     int result = ng_init_resources();
     if (!result)
@@ -70,10 +199,6 @@ void ng_init_graphics(int width,
 
     atexit(ng_free_resources);
 
-    ng_on_update_dt = update_func;
-    ng_on_render = render_func;
-
-    glutIdleFunc(ng_on_update);
     glutKeyboardFunc(ng_on_keyboard_press);
     glutKeyboardUpFunc(ng_on_keyboard_release);
     glutMouseFunc(ng_on_mouse_input);
@@ -82,29 +207,274 @@ void ng_init_graphics(int width,
     glutDisplayFunc(ng_on_clear_and_render);
     glutReshapeFunc(ng_on_reshape);
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
-    glAlphaFunc(GL_GREATER, 0.01);
+    ng_gl_blend(1, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (ng_backend == NG_BACKEND_OPENGL)
+        glAlphaFunc(GL_GREATER, 0.01);
     //glEnable(GL_ALPHA_TEST);
 
     ng_on_reshape(width, height);
+
+    // traces keep their order only when everything is on one thread
+    if (ng_render_thread && !ng_trace_recording && !ng_trace_replaying)
+    {
+        ng_last_time_us = ng_get_time_us();
+        if (ng_commands_start(ng_run_logic))
+        {
+            glutDisplayFunc(ng_commands_display);
+            glutIdleFunc(ng_commands_idle);
+            glutMainLoop();
+            return;
+        }
+    }
+
     ng_on_clear_and_render();
     glutPostRedisplay();
 
     ng_set_color(0);
+    ng_last_time_us = ng_get_time_us();
+    if (ng_trace_replaying)
+    {
+#ifdef GLUT_ACTION_ON_WINDOW_CLOSE
+        // ng_quit leaves the loop, so ng_replay_trace returns
+        glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE,
+                      GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+#endif
+        glutIdleFunc(ng_run_frame);
+    }
+    else
+        glutTimerFunc(0, ng_on_timer, 0);
     glutMainLoop();
 }
 
+void ng_set_backend(int backend)
+{
+    ng_backend = backend;
+}
+
+void ng_set_update_rate(int hz)
+{
+    ng_update_rate = hz;
+    if (hz > 0)
+        ng_step_us = 1000000 / hz;
+}
+
+int ng_get_update_rate()
+{
+    return ng_update_rate > 0 ? ng_update_rate : NG_DEFAULT_UPDATE_RATE;
+}
+
+long long ng_get_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void ng_set_threads(int threads)
+{
+    ng_threads = threads;
+}
+
+void ng_set_render_thread(int enabled)
+{
+    ng_render_thread = enabled;
+}
+
+void ng_set_headless(int enabled)
+{
+    ng_headless = enabled;
+}
+
+void ng_set_frame_limit(int frames)
+{
+    ng_frame_limit = frames;
+}
+
+void ng_quit()
+{
+    if (ng_backend == NG_BACKEND_SOFTWARE || ng_headless ||
+        ng_commands_recording())
+        ng_quit_requested = 1;
+#ifdef GLUT_ACTION_ON_WINDOW_CLOSE
+    else if (ng_trace_replaying)
+    {
+        ng_quit_requested = 1;
+        glutLeaveMainLoop();
+    }
+#endif
+    else
+        exit(EXIT_SUCCESS);
+}
+
+const unsigned char* ng_get_framebuffer(int* width, int* height)
+{
+    if (ng_backend == NG_BACKEND_SOFTWARE)
+        return ng_soft_get_pixels(width, height);
+    if (ng_headless)
+        return ng_egl_get_pixels(width, height);
+    return NULL;
+}
+
 void ng_force_redraw()
 {
-    glutPostRedisplay();
+    if (ng_commands_recording())
+        ng_redraw_requested = 1;
+    else if (ng_backend != NG_BACKEND_SOFTWARE && !ng_headless)
+        glutPostRedisplay();
+}
+
+// the headless backend has no events and no vsync, so it runs as fast as
+// it can with one fixed update step per rendered frame
+void ng_run_headless()
+{
+    int frame;
+    ng_set_color(0);
+    for (frame = 0; ng_frame_limit <= 0 || frame < ng_frame_limit; ++frame)
+    {
+        ng_run_frame();
+        if (ng_quit_requested)
+            break;
+    }
+}
+
+// the software backend has no window either
+void ng_init_software(int width, int height)
+{
+    ng_headless = 1;
+    if (!ng_soft_init(width, height, ng_threads) || !ng_init_batch())
+        return;
+    atexit(ng_free_headless);
+    ng_run_headless();
+}
+
+// the GL backends without a window run the headless loop too, and the
+// context goes after the resources at exit; without EGL the software
+// backend draws the frames instead
+void ng_init_surfaceless(int width, int height)
+{
+    atexit(ng_egl_free);
+    int available = ng_egl_init(width, height);
+    if (available)
+    {
+        // glewInit wants a GLX display, the functions don't
+        glewExperimental = GL_TRUE;
+        GLenum glew_status = glewContextInit();
+        if (glew_status != GLEW_OK)
+        {
+            fprintf(stderr, "Error: %s\n", glewGetErrorString(glew_status));
+            available = 0;
+        }
+    }
+    if (available && ng_backend == NG_BACKEND_GL33 && !GLEW_VERSION_3_3)
+    {
+        fprintf(stderr, "OpenGL 3.3 isn't available, using OpenGL 2.0\n");
+        ng_backend = NG_BACKEND_OPENGL;
+    }
+    if (!available || !ng_egl_init_framebuffer())
+    {
+        ng_egl_free();
+        fprintf(stderr, "surfaceless EGL isn't available, using the software "
+                        "backend\n");
+        ng_backend = NG_BACKEND_SOFTWARE;
+        ng_init_software(width, height);
+        return;
+    }
+    if (!ng_init_resources())
+        return;
+    atexit(ng_free_resources);
+
+    ng_gl_blend(1, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (ng_backend == NG_BACKEND_OPENGL)
+        glAlphaFunc(GL_GREATER, 0.01);
+    ng_on_reshape(width, height);
+    ng_run_headless();
+}
+
+// one update and one frame without waiting, for the headless loop and
+// for replays on GL
+void ng_run_frame()
+{
+    ng_run_update();
+    if (!ng_quit_requested)
+        ng_on_clear_and_render();
+}
+
+// the scheduler of ng_on_timer on the logic thread, which sleeps by
+// itself and records a frame after the updates that asked for one; the
+// first frame is followed by a redraw, like the window's first display
+void ng_run_logic()
+{
+    ng_on_clear_and_render();
+    ng_set_color(0);
+    ng_redraw_requested = 1;
+    while (!ng_quit_requested && !ng_commands_stopping())
+    {
+        if (ng_redraw_requested)
+        {
+            ng_redraw_requested = 0;
+            ng_on_clear_and_render();
+        }
+
+        long long next = ng_last_time_us + ng_step_us - ng_accumulator_us;
+        if (next > ng_get_time_us())
+            ng_sleep_until(next);
+        ng_run_updates(ng_get_time_us());
+    }
+}
+
+void ng_free_headless()
+{
+    free(ng_batch_vertices);
+    ng_batch_vertices = NULL;
+    ng_loader_free();
+    ng_capture_free();
+    ng_trace_close();
+    ng_plot_free();
+    ng_soft_free();
 }
 
 void ng_on_clear_and_render()
 {
-    glClear(GL_COLOR_BUFFER_BIT);
+    long long start = ng_get_time_us();
+    ng_loader_poll();
+    if (ng_backend == NG_BACKEND_SOFTWARE)
+        ng_soft_clear();
+    else if (!ng_commands_recording())
+    {
+        ng_gl_scissor(0, 0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
     ng_on_render();
-    glutSwapBuffers();
+    long long rendered = ng_get_time_us();
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_FRAME, 0);
+
+    ng_saved_color color;
+    ng_save_color(&color);
+    ng_trace_pause();
+    ng_profile_draw_overlay();
+    ng_restore_color(&color);
+    ng_trace_resume();
+
+    ng_batch_flush();
+    if (ng_commands_recording())
+    {
+        // the render thread clears, swaps and ends the frame
+        ng_commands_publish(rendered - start);
+        return;
+    }
+    if (ng_backend == NG_BACKEND_SOFTWARE)
+        ng_soft_present();
+    ng_capture_read(ng_headless);
+    if (ng_backend != NG_BACKEND_SOFTWARE)
+    {
+        if (ng_headless)
+            ng_egl_present();
+        else
+            glutSwapBuffers();
+    }
+    ng_profile_end_frame(rendered - start, ng_get_time_us() - rendered);
 }
 
 void ng_on_reshape(int width, int height)
@@ -113,72 +483,199 @@ void ng_on_reshape(int width, int height)
     if (height <= 0) height = 1;
     ng_window_width = width;
     ng_window_height = height;
+    ng_input_resize(width, height);
+    glViewport(0, 0, width, height);
     glClearColor(0.0, 0.0, 0.0, 1.0);
 }
 
 int ng_init_resources()
 {
-    GLint result = GL_FALSE;
-
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    const char *vs_source =
-        //"#version 120\n"  // OpenGL 2.1
+    static const char* vs_source =
         "attribute vec2 coord2d;"
+        "attribute vec2 texcoord;"
+        "attribute vec4 color;"
+        "uniform vec2 resolution;"
+        "varying vec2 f_texcoord;"
+        "varying vec4 f_color;"
         "void main(void) {"
-        "  vec2 coords = vec2(coord2d * 2.0) - vec2(1.0, 1.0);"
+        "  vec2 coords = coord2d / resolution * 2.0 - vec2(1.0, 1.0);"
         "  gl_Position = vec4(coords, 0.0, 1.0);"
+        "  f_texcoord = texcoord;"
+        "  f_color = color;"
         "}";
-    glShaderSource(vs, 1, &vs_source, NULL);
+    static const char* fs_source =
+        "uniform sampler2D atlas;"
+        "varying vec2 f_texcoord;"
+        "varying vec4 f_color;"
+        "void main(void) {"
+        "  ng_frag_color = f_color * texture2D(atlas, f_texcoord);"
+        "}";
+    static const char* attributes[] = { "coord2d", "color", "texcoord" };
+
+    ng_program = ng_compile_program(vs_source, fs_source, attributes, 3);
+    if (ng_program == 0)
+        return 0;
+
+    ng_attribute_coord2d = glGetAttribLocation(ng_program, "coord2d");
+    ng_attribute_color = glGetAttribLocation(ng_program, "color");
+    ng_attribute_texcoord = glGetAttribLocation(ng_program, "texcoord");
+    ng_uniform_resolution = glGetUniformLocation(ng_program, "resolution");
+    ng_uniform_atlas = glGetUniformLocation(ng_program, "atlas");
+    if (ng_attribute_coord2d == -1 || ng_attribute_color == -1 ||
+        ng_attribute_texcoord == -1 || ng_uniform_resolution == -1 ||
+        ng_uniform_atlas == -1)
+    {
+        fprintf(stderr, "shader variables issue\n");
+        return 0;
+    }
+
+    // the atlas stays on texture unit 0
+    ng_gl_use_program(ng_program);
+    glUniform1i(ng_uniform_atlas, 0);
+
+    glGenBuffers(1, &ng_batch_vbo);
+    glGenBuffers(1, &ng_quad_indices);
+
+    return ng_pool_init(ng_threads) && ng_init_font_texture() &&
+           ng_init_batch();
+}
+
+// the glyphs and the white texel share one texture, so text, rectangles
+// and lines all go through the same draw call
+int ng_init_font_texture()
+{
+    GLubyte* rgba = malloc(NG_FONT_ATLAS_WIDTH * NG_FONT_ATLAS_HEIGHT * 4);
+    if (rgba == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    ng_font_bake(rgba);
+
+    glGenTextures(1, &ng_font_texture);
+    ng_gl_bind_texture(ng_font_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, NG_FONT_ATLAS_WIDTH,
+                 NG_FONT_ATLAS_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    free(rgba);
+    return 1;
+}
+
+int ng_init_batch()
+{
+    ng_batch_capacity = NG_BATCH_INITIAL_CAPACITY;
+    ng_batch_vertices = malloc(ng_batch_capacity * sizeof(ng_vertex));
+    if (ng_batch_vertices == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+void ng_free_resources()
+{
+    ng_commands_free();
+    ng_capture_free();
+    ng_instanced_free();
+    if (ng_batch_vao != 0)
+        ng_gl_delete_vertex_array(ng_batch_vao);
+    ng_gl_delete_buffer(ng_batch_vbo);
+    ng_gl_delete_buffer(ng_quad_indices);
+    ng_gl_delete_texture(ng_font_texture);
+    ng_loader_free();
+    ng_trace_close();
+    ng_sprites_free();
+    free(ng_batch_vertices);
+    ng_batch_vertices = NULL;
+    ng_gl_delete_program(ng_program);
+    ng_plot_free();
+    ng_pool_free();
+}
+
+// compiles and links a program with attributes[i] bound to location i;
+// the sources are GLSL 1.10 writing ng_frag_color, and a prefix maps
+// them onto GLSL 3.30 for the core profile
+GLuint ng_compile_program(const char* vs_source, const char* fs_source,
+                          const char* const* attributes, int count)
+{
+    static const char* vs_prefix_gl2 = "#version 110\n";
+    static const char* fs_prefix_gl2 =
+        "#version 110\n"
+        "#define ng_frag_color gl_FragColor\n";
+    static const char* vs_prefix_gl33 =
+        "#version 330 core\n"
+        "#define attribute in\n"
+        "#define varying out\n";
+    static const char* fs_prefix_gl33 =
+        "#version 330 core\n"
+        "#define varying in\n"
+        "#define texture2D texture\n"
+        "out vec4 ng_frag_color;\n";
+    int gl33 = ng_backend == NG_BACKEND_GL33;
+    const char* vs_sources[2] = { gl33 ? vs_prefix_gl33 : vs_prefix_gl2, vs_source };
+    const char* fs_sources[2] = { gl33 ? fs_prefix_gl33 : fs_prefix_gl2, fs_source };
+    GLint result = GL_FALSE;
+
+    int cache = ng_program_cache_available();
+    unsigned long long key = 0;
+    if (cache)
+    {
+        key = ng_program_key(vs_sources, fs_sources, 2, attributes, count);
+        GLuint program = ng_program_cache_load(key);
+        if (program != 0)
+            return program;
+    }
+
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 2, vs_sources, NULL);
     glCompileShader(vs);
     glGetShaderiv(vs, GL_COMPILE_STATUS, &result);
     if (!result)
     {
         ng_log_shader("vertex shader", vs);
+        glDeleteShader(vs);
         return 0;
     }
 
     GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    const char *fs_source =
-        //"#version 120\n"
-        "uniform vec4 color;"
-        "void main(void) {"
-        "  gl_FragColor = color;"
-        "}";
-
-    glShaderSource(fs, 1, &fs_source, NULL);
+    glShaderSource(fs, 2, fs_sources, NULL);
     glCompileShader(fs);
     glGetShaderiv(fs, GL_COMPILE_STATUS, &result);
     if (!result)
     {
         ng_log_shader("fragment shader", fs);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
         return 0;
     }
 
-    ng_program = glCreateProgram();
-    glAttachShader(ng_program, vs);
-    glAttachShader(ng_program, fs);
-    glLinkProgram(ng_program);
-    glGetProgramiv(ng_program, GL_LINK_STATUS, &result);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    int i;
+    for (i = 0; i < count; ++i)
+        glBindAttribLocation(program, i, attributes[i]);
+    if (cache)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
     if (!result)
     {
         fprintf(stderr, "glLinkProgram failed\n");
+        glDeleteProgram(program);
         return 0;
     }
 
-    ng_attribute_coord2d = glGetAttribLocation(ng_program, "coord2d");
-    ng_uniform_color = glGetUniformLocation(ng_program, "color");
-    if (ng_attribute_coord2d == -1 || ng_uniform_color == -1)
-    {
-        fprintf(stderr, "shader variables issue\n");
-        return 0;
-    }
-
-    return 1;
-}
-
-void ng_free_resources()
-{
-    glDeleteProgram(ng_program);
+    if (cache)
+        ng_program_cache_save(key, program);
+    return program;
 }
 
 void ng_log_shader(const char* tag, GLuint i)
@@ -196,154 +693,465 @@ void ng_set_color(unsigned int rgba_color)
     if (ng_rgba_color == rgba_color)
         return;
 
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_COLOR, 1, (int)rgba_color);
     ng_rgba_color = rgba_color;
+    ng_packed_color[0] = (GLubyte)(rgba_color >> 24);
+    ng_packed_color[1] = (GLubyte)(rgba_color >> 16);
+    ng_packed_color[2] = (GLubyte)(rgba_color >> 8);
+    ng_packed_color[3] = (GLubyte)rgba_color;
+}
 
-    GLfloat c[4];
-    ng_convert_color(rgba_color, c, c+1, c+2, c+3);
+void ng_save_color(ng_saved_color* saved)
+{
+    saved->rgba = ng_rgba_color;
+    memcpy(saved->packed, ng_packed_color, sizeof(ng_packed_color));
+}
 
-    glUniform4fv(ng_uniform_color, 1, c);
+// the trace is paused while other colors are used, so it never saw them
+void ng_restore_color(const ng_saved_color* saved)
+{
+    ng_rgba_color = saved->rgba;
+    memcpy(ng_packed_color, saved->packed, sizeof(ng_packed_color));
 }
 
-void ng_convert_color(unsigned int rgba_color,
-                      GLfloat* r, GLfloat* g, GLfloat* b, GLfloat* a)
+ng_vertex* ng_batch_reserve(GLenum mode, int vertices, GLfloat line_width,
+                            int page)
 {
-    int ir = rgba_color >> 24;
-    int ig = (rgba_color << 8) >> 24;
-    int ib = (rgba_color << 16) >> 24;
-    int ia = (rgba_color << 24) >> 24;
-    *r = ir / 255.0f;
-    *g = ig / 255.0f;
-    *b = ib / 255.0f;
-    *a = ia / 255.0f;
+    if (ng_geometry_recording())
+        return ng_geometry_reserve(mode, vertices, line_width, page);
+    if (ng_commands_recording())
+        return ng_commands_reserve(mode, vertices, line_width, page);
+
+    if (page == NG_ANY_PAGE)
+        page = ng_batch_page;
+    if (ng_batch_size > 0 &&
+        (mode != ng_batch_mode || page != ng_batch_page ||
+         (mode == GL_LINES && line_width != ng_batch_line_width)))
+        ng_batch_flush();
+
+    ng_batch_mode = mode;
+    ng_batch_line_width = line_width;
+    ng_batch_page = page;
+
+    if (ng_batch_size + vertices > ng_batch_capacity)
+    {
+        int capacity = ng_batch_capacity * 2;
+        while (ng_batch_size + vertices > capacity)
+            capacity *= 2;
+
+        ng_vertex* v = realloc(ng_batch_vertices,
+                               capacity * sizeof(ng_vertex));
+        if (v == NULL)
+        {
+            ng_batch_flush();
+            if (vertices > ng_batch_capacity)
+                return NULL;
+        }
+        else
+        {
+            ng_batch_vertices = v;
+            ng_batch_capacity = capacity;
+        }
+    }
+
+    ng_vertex* result = ng_batch_vertices + ng_batch_size;
+    ng_batch_size += vertices;
+    return result;
+}
+
+void ng_batch_flush()
+{
+    // a thread recording commands has no batch of its own
+    if (ng_commands_recording() || ng_batch_size == 0)
+        return;
+
+    if (ng_backend != NG_BACKEND_SOFTWARE)
+    {
+        GLsizeiptr bytes = ng_batch_size * sizeof(ng_vertex);
+        ng_gl_bind_buffer(GL_ARRAY_BUFFER, ng_batch_vbo);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, ng_batch_vertices);
+    }
+
+    ng_draw_vertices(ng_batch_vbo, &ng_batch_vao, ng_batch_vertices,
+                     ng_batch_mode, 0, ng_batch_size, ng_batch_line_width,
+                     ng_batch_page);
+    ng_batch_size = 0;
 }
 
-void ng_draw_line(int x0, int y0, int x1, int y1, int width)
+// draws count vertices starting at first, taken from the buffer object on
+// the GL backends and from the array on the software backend; the core
+// profile keeps the layout of every buffer in its vertex array object
+void ng_draw_vertices(GLuint vbo, GLuint* vao, const ng_vertex* vertices,
+                      GLenum mode, int first, int count, GLfloat line_width,
+                      int page)
 {
-    glUseProgram(ng_program);
-    glEnableVertexAttribArray(ng_attribute_coord2d);
+    if (ng_commands_recording())
+    {
+        ng_commands_draw(vertices + first, mode, count, line_width, page);
+        return;
+    }
 
-    GLfloat ww = (GLfloat)ng_window_width;
-    GLfloat wh = (GLfloat)ng_window_height;
+    ng_profile_draw(NG_PIPELINE_BATCH, mode, line_width, count);
+    if (ng_backend == NG_BACKEND_SOFTWARE)
+    {
+        ng_soft_draw(mode, vertices + first, count, line_width, page);
+        return;
+    }
 
-    GLfloat x0f = x0 / ww;
-    GLfloat y0f = y0 / wh;
-    GLfloat x1f = x1 / ww;
-    GLfloat y1f = y1 / wh;
+    ng_gl_use_program(ng_program);
+    if (ng_program_width != ng_window_width ||
+        ng_program_height != ng_window_height)
+    {
+        glUniform2f(ng_uniform_resolution,
+                    (GLfloat)ng_window_width, (GLfloat)ng_window_height);
+        ng_program_width = ng_window_width;
+        ng_program_height = ng_window_height;
+    }
+    ng_gl_bind_texture(page == 0 ? ng_font_texture : ng_page_texture(page));
 
-    GLfloat verts[] = {
-        x0f, y0f,
-        x1f, y1f
-    };
+    if (ng_backend == NG_BACKEND_GL33)
+    {
+        if (*vao == 0)
+        {
+            glGenVertexArrays(1, vao);
+            ng_gl_bind_vertex_array(*vao);
+            ng_vertex_attributes(vbo, 0);
+        }
+        ng_gl_bind_vertex_array(*vao);
+    }
+    else
+    {
+        // without a base vertex the attributes start at first
+        ng_vertex_attributes(vbo, first);
+        first = 0;
+    }
+    if (mode == NG_QUADS && !ng_reserve_quad_indices(count / 4))
+        return;
 
-    glVertexAttribPointer(ng_attribute_coord2d, 2, GL_FLOAT, GL_FALSE, 0, verts);
+    if (mode == GL_LINES)
+        ng_gl_line_width(line_width);
+    if (mode != NG_QUADS)
+        glDrawArrays(mode, first, count);
+    else if (ng_backend == NG_BACKEND_GL33)
+        glDrawElementsBaseVertex(GL_TRIANGLES, count / 4 * 6, GL_UNSIGNED_INT,
+                                 NULL, first);
+    else
+        glDrawElements(GL_TRIANGLES, count / 4 * 6, GL_UNSIGNED_INT, NULL);
+}
 
-    glLineWidth((GLfloat)width);
-    glDrawArrays(GL_LINES, 0, 2);
+void ng_vertex_attributes(GLuint vbo, int first)
+{
+    size_t base = first * sizeof(ng_vertex);
 
-    glDisableVertexAttribArray(ng_attribute_coord2d);
+    ng_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
+    ng_gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ng_quad_indices);
+    ng_gl_enable_attributes(1u << ng_attribute_coord2d |
+                            1u << ng_attribute_color |
+                            1u << ng_attribute_texcoord);
+    ng_gl_attribute_divisor(ng_attribute_color, 0);
+    ng_gl_attribute_divisor(ng_attribute_texcoord, 0);
+    glVertexAttribPointer(ng_attribute_coord2d, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(ng_vertex),
+                          (const GLvoid*)(base + offsetof(ng_vertex, x)));
+    glVertexAttribPointer(ng_attribute_texcoord, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(ng_vertex),
+                          (const GLvoid*)(base + offsetof(ng_vertex, u)));
+    glVertexAttribPointer(ng_attribute_color, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(ng_vertex),
+                          (const GLvoid*)(base + offsetof(ng_vertex, color)));
+}
+
+// quad i is drawn as the triangles 4i, 4i+1, 4i+2 and 4i, 4i+2, 4i+3;
+// the element buffer only grows, so the vertex arrays that reference it
+// stay valid
+int ng_reserve_quad_indices(int quads)
+{
+    if (quads <= ng_quad_indices_count)
+        return 1;
+
+    int n = ng_quad_indices_count > 0 ? ng_quad_indices_count * 2
+                                      : NG_BATCH_INITIAL_CAPACITY;
+    while (n < quads)
+        n *= 2;
+
+    GLuint* indices = malloc(n * 6 * sizeof(GLuint));
+    if (indices == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+
+    int i;
+    for (i = 0; i < n; ++i)
+    {
+        GLuint* p = indices + i * 6;
+        GLuint v = i * 4;
+        p[0] = v;
+        p[1] = v + 1;
+        p[2] = v + 2;
+        p[3] = v;
+        p[4] = v + 2;
+        p[5] = v + 3;
+    }
+
+    // the bound vertex array already has it as its element buffer
+    ng_gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ng_quad_indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * 6 * sizeof(GLuint), indices,
+                 GL_STATIC_DRAW);
+    free(indices);
+    ng_quad_indices_count = n;
+    return 1;
+}
+
+void* ng_grow(void* array, int* capacity, int needed, size_t item)
+{
+    if (needed <= *capacity)
+        return array;
+
+    int c = *capacity > 0 ? *capacity * 2 : 256;
+    while (c < needed)
+        c *= 2;
+
+    void* result = realloc(array, c * item);
+    if (result == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return NULL;
+    }
+    *capacity = c;
+    return result;
+}
+
+void ng_put_vertex(ng_vertex* v, GLfloat x, GLfloat y)
+{
+    v->x = x;
+    v->y = y;
+    v->u = NG_WHITE_U;
+    v->v = NG_WHITE_V;
+    memcpy(v->color, ng_packed_color, sizeof(ng_packed_color));
 }
 
 void ng_draw_rectangle(int x0, int y0, int x1, int y1)
 {
-    glUseProgram(ng_program);
-    glEnableVertexAttribArray(ng_attribute_coord2d);
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_RECTANGLE, 4, x0, y0, x1, y1);
+    ng_vertex* v = ng_batch_reserve(NG_QUADS, 4, 1.0f, NG_ANY_PAGE);
+    if (v == NULL)
+        return;
 
-    GLfloat ww = (GLfloat)ng_window_width;
-    GLfloat wh = (GLfloat)ng_window_height;
+    GLfloat x0f = (GLfloat)x0;
+    GLfloat y0f = (GLfloat)y0;
+    GLfloat x1f = (GLfloat)x1;
+    GLfloat y1f = (GLfloat)y1;
 
-    GLfloat x0f = x0 / ww;
-    GLfloat y0f = y0 / wh;
-    GLfloat x1f = x1 / ww;
-    GLfloat y1f = y1 / wh;
+    ng_put_vertex(v,   x0f, y0f);
+    ng_put_vertex(v+1, x0f, y1f);
+    ng_put_vertex(v+2, x1f, y1f);
+    ng_put_vertex(v+3, x1f, y0f);
+}
 
-    GLfloat verts[] = {
-        x0f, y0f,
-        x0f, y1f,
-        x1f, y1f,
-        x1f, y0f,
-    };
+// the GL path can't be recorded into a geometry or a command list, so
+// those go through the batch like the software backend
+int ng_bulk_instanced()
+{
+    return ng_backend != NG_BACKEND_SOFTWARE && !ng_geometry_recording() &&
+           !ng_commands_recording() && ng_instanced_init();
+}
 
-    glVertexAttribPointer(ng_attribute_coord2d, 2, GL_FLOAT, GL_FALSE, 0, verts);
+void ng_draw_rectangles(const ng_rect* rects, int count)
+{
+    if (count <= 0)
+        return;
+    if (ng_trace_recording)
+        ng_trace_array(NG_TRACE_RECTANGLES, 0, rects, count, 5);
+    if (ng_bulk_instanced())
+    {
+        ng_batch_flush();
+        ng_instanced_draw(GL_TRIANGLES, rects, count, 1.0f);
+        return;
+    }
 
-    glDrawArrays(GL_QUADS, 0, 4);
-    glDisableVertexAttribArray(ng_attribute_coord2d);
+    ng_saved_color color;
+    int i;
+    ng_save_color(&color);
+    ng_trace_pause();
+    for (i = 0; i < count; ++i)
+    {
+        ng_set_color(rects[i].color);
+        ng_draw_rectangle(rects[i].x0, rects[i].y0, rects[i].x1, rects[i].y1);
+    }
+    ng_restore_color(&color);
+    ng_trace_resume();
 }
 
-void ng_draw_text(int x, int y, const char* text)
+void ng_draw_lines(const ng_line* lines, int count, int width)
 {
-    GLfloat r, g, b, a;
-    void* font = GLUT_BITMAP_9_BY_15;
-    glRasterPos2f(x, y);
-    size_t len, i;
-    len = (size_t) strlen(text);
-    for (i = 0; i < len; i++)
-        glutBitmapCharacter(font, text[i]);
+    if (count <= 0)
+        return;
+    if (ng_trace_recording)
+        ng_trace_array(NG_TRACE_LINES, width, lines, count, 5);
+    if (ng_bulk_instanced())
+    {
+        ng_batch_flush();
+        ng_instanced_draw(GL_LINES, lines, count, (GLfloat)width);
+        return;
+    }
+
+    ng_saved_color color;
+    int i;
+    ng_save_color(&color);
+    ng_trace_pause();
+    for (i = 0; i < count; ++i)
+    {
+        ng_set_color(lines[i].color);
+        ng_draw_line(lines[i].x0, lines[i].y0, lines[i].x1, lines[i].y1, width);
+    }
+    ng_restore_color(&color);
+    ng_trace_resume();
 }
 
-void ng_get_mouse(int* x, int* y, int* button, int* state)
+void ng_draw_text(int x, int y, const char* text)
 {
-    *x = ng_mouse_x;
-    *y = ng_mouse_y;
-    *button = ng_mouse_button;
-    *state = ng_mouse_state;
+    if (ng_trace_recording)
+        ng_trace_text(x, y, text);
+    // the software rasterizer draws text directly, and records the same
+    // glyph quads as GL into geometries and command lists
+    if (ng_backend == NG_BACKEND_SOFTWARE && !ng_geometry_recording() &&
+        !ng_commands_recording())
+    {
+        ng_batch_flush();
+        ng_profile_draw(NG_PIPELINE_TEXT, GL_TRIANGLES, 1.0f, 0);
+        ng_soft_draw_text(x, y, text, ng_packed_color);
+        return;
+    }
+
+    const GLfloat du = (GLfloat)NG_FONT_WIDTH / NG_FONT_ATLAS_WIDTH;
+    const GLfloat dv = (GLfloat)NG_FONT_HEIGHT / NG_FONT_ATLAS_HEIGHT;
+    GLfloat y0 = (GLfloat)(y - NG_FONT_DESCENT);
+    GLfloat y1 = y0 + NG_FONT_HEIGHT;
+
+    for (; *text != '\0'; ++text, x += NG_FONT_WIDTH)
+    {
+        int c = (unsigned char)*text - NG_FONT_FIRST;
+        if (c <= 0 || c >= NG_FONT_GLYPHS)
+            continue;
+
+        ng_vertex* v = ng_batch_reserve(NG_QUADS, 4, 1.0f, 0);
+        if (v == NULL)
+            return;
+
+        GLfloat x0 = (GLfloat)x;
+        GLfloat x1 = x0 + NG_FONT_WIDTH;
+        GLfloat u0 = (c % NG_FONT_ATLAS_COLUMNS) * du;
+        GLfloat v0 = (c / NG_FONT_ATLAS_COLUMNS) * dv;
+
+        ng_put_vertex(v,   x0, y0);
+        ng_put_vertex(v+1, x0, y1);
+        ng_put_vertex(v+2, x1, y1);
+        ng_put_vertex(v+3, x1, y0);
+        v[0].u = v[1].u = u0;
+        v[2].u = v[3].u = u0 + du;
+        v[0].v = v[3].v = v0;
+        v[1].v = v[2].v = v0 + dv;
+    }
 }
 
-void ng_get_keyboard(unsigned char* key, int* state)
+void ng_push_event(int type, int x, int y, int button, int state,
+                   unsigned char key)
 {
-    *key = ng_keyboard_key;
-    *state = ng_keyboard_state;
-    ng_keyboard_state = RELEASED;
+    ng_event e;
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    e.time_us = ng_get_time_us();
+    e.x = x;
+    e.y = y;
+    e.button = button;
+    e.state = state;
+    e.key = key;
+    ng_input_push(&e);
 }
 
 void ng_on_mouse_input(int button, int state, int x, int y)
 {
-    ng_mouse_x = x;
-    ng_mouse_y = y;
-    ng_mouse_button = button;
-    ng_mouse_state = state;
-    ng_on_update();
+    ng_push_event(NG_EVENT_MOUSE_BUTTON, x, y, button, state, 0);
 }
 
 void ng_on_mouse_move(int x, int y)
 {
-    ng_mouse_x = x;
-    ng_mouse_y = y;
-    ng_on_update();
+    ng_push_event(NG_EVENT_MOUSE_MOVE, x, y, 0, MOVED, 0);
 }
 
 void ng_on_keyboard_press(unsigned char key, int x, int y)
 {
-    ng_mouse_x = x;
-    ng_mouse_y = y;
-    ng_keyboard_key = key;
-    ng_keyboard_state = PRESSED;
-    ng_on_update();
+    ng_push_event(NG_EVENT_KEY_PRESS, x, y, 0, PRESSED, key);
 }
 
 void ng_on_keyboard_release(unsigned char key, int x, int y)
 {
-    ng_mouse_x = x;
-    ng_mouse_y = y;
-    ng_keyboard_key = key;
-    ng_keyboard_state = RELEASED;
-    ng_on_update();
+    ng_push_event(NG_EVENT_KEY_RELEASE, x, y, 0, RELEASED, key);
 }
 
-int ng_get_window_size(int* width, int* height)
+// sleeps in GLUT's event wait until a millisecond before the next step,
+// then finishes the wait with an absolute monotonic sleep
+void ng_on_timer(int value)
 {
-    *width = ng_window_width;
-    *height = ng_window_height;
+    long long now = ng_get_time_us();
+    long long next = ng_last_time_us + ng_step_us - ng_accumulator_us;
+    if (next > now)
+    {
+        ng_sleep_until(next);
+        now = ng_get_time_us();
+    }
+
+    ng_run_updates(now);
+
+    next = ng_last_time_us + ng_step_us - ng_accumulator_us;
+    now = ng_get_time_us();
+    glutTimerFunc(next > now + 1000 ? (unsigned int)((next - now) / 1000) - 1 : 0,
+                  ng_on_timer, value);
 }
 
-void ng_on_update()
+void ng_run_updates(long long now)
 {
-    static int time_base = -1;
-    int time = glutGet(GLUT_ELAPSED_TIME);
-    if (time_base < 0)
-        time_base = time;
+    ng_accumulator_us += now - ng_last_time_us;
+    ng_last_time_us = now;
 
-    ng_on_update_dt(ng_dt);
+    // after a stall, drop the time that can't be caught up with
+    if (ng_accumulator_us > NG_MAX_CATCHUP_STEPS * ng_step_us)
+        ng_accumulator_us = NG_MAX_CATCHUP_STEPS * ng_step_us;
 
-    ng_dt = time - time_base;
-    time_base = time;
+    while (ng_accumulator_us >= ng_step_us)
+    {
+        ng_accumulator_us -= ng_step_us;
+        ng_run_update();
+    }
+}
+
+void ng_run_update()
+{
+    long long start = ng_get_time_us();
+    ng_input_feed();
+    int dt = ng_next_step_dt();
+    ng_on_update_dt(dt);
+    ng_profile_update(ng_get_time_us() - start);
+    ng_capture_step();
+}
+
+int ng_next_step_dt()
+{
+    ng_dt_carry_us += ng_step_us;
+    int dt = (int)(ng_dt_carry_us / 1000);
+    ng_dt_carry_us -= dt * 1000LL;
+    return dt;
+}
+
+void ng_sleep_until(long long time_us)
+{
+    struct timespec ts;
+    ts.tv_sec = time_us / 1000000;
+    ts.tv_nsec = (time_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
 }
@@ -0,0 +1,319 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* decimation splits the points into chunks reduced in parallel on the
+   pool; every chunk writes its result where its input starts, so the
+   results only have to be moved together afterwards */
+#define NG_PLOT_CHUNK 65536
+
+/* merges the sorted centers of one column into spans */
+typedef struct
+{
+    ng_rect* out;
+    int count;
+    int x;
+    int gap;
+    int y0, y1;
+    int open;
+} ng_plot_spans;
+
+typedef struct
+{
+    const ng_point* points;
+    int count;
+    int size;
+    void* result;
+    int* result_counts;
+    int* ys;                // sort scratch, one int per point
+    unsigned int* bits;     // bitmap scratch, one word per point
+} ng_plot_job;
+
+static void ng_plot_polyline_chunk(int chunk, void* ctx);
+static void ng_plot_points_chunk(int chunk, void* ctx);
+static int ng_plot_run(ng_plot_job* job, ng_task_func func, size_t item);
+static int ng_plot_reserve(int count, size_t item);
+static int ng_plot_compare_y(const void* a, const void* b);
+static void ng_plot_span_add(ng_plot_spans* spans, int y);
+static void ng_plot_span_end(ng_plot_spans* spans);
+
+/* scratch of the calling thread, so threads recording command lists
+   plot at the same time */
+static int ng_decimation;
+static _Thread_local void* ng_plot_buffer;
+static _Thread_local size_t ng_plot_buffer_size;
+static _Thread_local int* ng_plot_ys;
+static _Thread_local int ng_plot_ys_capacity;
+static _Thread_local unsigned int* ng_plot_bits;
+static _Thread_local int ng_plot_bits_capacity;
+static _Thread_local int* ng_plot_counts;
+static _Thread_local int ng_plot_counts_capacity;
+
+void ng_set_decimation(int enabled)
+{
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_DECIMATION, 1, enabled);
+    ng_decimation = enabled;
+}
+
+void ng_plot_free()
+{
+    free(ng_plot_buffer);
+    free(ng_plot_ys);
+    free(ng_plot_bits);
+    free(ng_plot_counts);
+    ng_plot_buffer = NULL;
+    ng_plot_buffer_size = 0;
+    ng_plot_ys = NULL;
+    ng_plot_ys_capacity = 0;
+    ng_plot_bits = NULL;
+    ng_plot_bits_capacity = 0;
+    ng_plot_counts = NULL;
+    ng_plot_counts_capacity = 0;
+}
+
+// a run of points in one column is drawn as the lines between its first,
+// lowest, highest and last point, so only those are kept, in order
+int ng_decimate_polyline(const ng_point* points, int count,
+                         const ng_point** result)
+{
+    *result = points;
+    if (!ng_decimation || count <= 4 ||
+        !ng_plot_reserve(count, sizeof(ng_point)))
+        return count;
+
+    ng_plot_job job = { .points = points, .count = count,
+                        .result = ng_plot_buffer,
+                        .result_counts = ng_plot_counts };
+    *result = ng_plot_buffer;
+    return ng_plot_run(&job, ng_plot_polyline_chunk, sizeof(ng_point));
+}
+
+// without decimation every point is its own square; with it the squares
+// of a run of points in one column that touch or overlap become one
+// rectangle, which covers the same pixels
+void ng_draw_points(const ng_point* points, int count, int size)
+{
+    int i;
+    if (ng_trace_recording)
+        ng_trace_array(NG_TRACE_POINTS, size, points, count, 2);
+    if (size < 1)
+        size = 1;
+    int h0 = size / 2, h1 = size - size / 2;
+
+    ng_trace_pause();
+    if (!ng_decimation || count <= 1 ||
+        !ng_plot_reserve(count, sizeof(ng_rect)))
+    {
+        for (i = 0; i < count; ++i)
+            ng_draw_rectangle(points[i].x - h0, points[i].y - h0,
+                              points[i].x + h1, points[i].y + h1);
+    }
+    else
+    {
+        ng_plot_job job = { .points = points, .count = count, .size = size,
+                            .result = ng_plot_buffer,
+                            .result_counts = ng_plot_counts,
+                            .ys = ng_plot_ys, .bits = ng_plot_bits };
+        const ng_rect* spans = ng_plot_buffer;
+        count = ng_plot_run(&job, ng_plot_points_chunk, sizeof(ng_rect));
+        for (i = 0; i < count; ++i)
+            ng_draw_rectangle(spans[i].x0 - h0, spans[i].y0 - h0,
+                              spans[i].x1 + h1, spans[i].y1 + h1);
+    }
+    ng_trace_resume();
+}
+
+int ng_plot_run(ng_plot_job* job, ng_task_func func, size_t item)
+{
+    int chunks = (job->count + NG_PLOT_CHUNK - 1) / NG_PLOT_CHUNK;
+    ng_pool_run(chunks, func, job);
+
+    char* result = job->result;
+    int count = job->result_counts[0];
+    int i;
+    for (i = 1; i < chunks; ++i)
+    {
+        memmove(result + count * item, result + (size_t)i * NG_PLOT_CHUNK * item,
+                job->result_counts[i] * item);
+        count += job->result_counts[i];
+    }
+    return count;
+}
+
+void ng_plot_polyline_chunk(int chunk, void* ctx)
+{
+    ng_plot_job* job = ctx;
+    int begin = chunk * NG_PLOT_CHUNK;
+    int end = begin + NG_PLOT_CHUNK < job->count ? begin + NG_PLOT_CHUNK
+                                                 : job->count;
+    const ng_point* p = job->points;
+    ng_point* out = (ng_point*)job->result + begin;
+    int n = 0;
+    int i = begin;
+
+    while (i < end)
+    {
+        int first = i, low = i, high = i;
+        for (++i; i < end && p[i].x == p[first].x; ++i)
+        {
+            if (p[i].y < p[low].y)
+                low = i;
+            if (p[i].y > p[high].y)
+                high = i;
+        }
+        int last = i - 1;
+
+        int keep[4] = { first, low < high ? low : high,
+                        low < high ? high : low, last };
+        int k;
+        for (k = 0; k < 4; ++k)
+        {
+            if (k == 0 || keep[k] != keep[k - 1])
+                out[n++] = p[keep[k]];
+        }
+    }
+    job->result_counts[chunk] = n;
+}
+
+// spans are ng_rects from x0, y0 to x1, y1 around the centers, x0 == x1;
+// a run's centers are sorted with a bitmap when their range fits in the
+// chunk's share of the bitmap scratch and with qsort otherwise
+void ng_plot_points_chunk(int chunk, void* ctx)
+{
+    ng_plot_job* job = ctx;
+    int begin = chunk * NG_PLOT_CHUNK;
+    int end = begin + NG_PLOT_CHUNK < job->count ? begin + NG_PLOT_CHUNK
+                                                 : job->count;
+    const ng_point* p = job->points;
+    int* ys = job->ys + begin;
+    unsigned int* bits = job->bits + begin;
+    ng_plot_spans spans = { .out = (ng_rect*)job->result + begin,
+                            .gap = job->size };
+    int i = begin;
+
+    while (i < end)
+    {
+        int first = i;
+        int low = p[i].y, high = p[i].y;
+        for (++i; i < end && p[i].x == p[first].x; ++i)
+        {
+            if (p[i].y < low)
+                low = p[i].y;
+            if (p[i].y > high)
+                high = p[i].y;
+        }
+
+        spans.x = p[first].x;
+        spans.open = 0;
+        unsigned int words = ((unsigned int)high - (unsigned int)low) / 32 + 1;
+        int k;
+        if (words <= (unsigned int)(end - begin))
+        {
+            memset(bits, 0, words * sizeof(unsigned int));
+            for (k = first; k < i; ++k)
+            {
+                unsigned int d = (unsigned int)p[k].y - (unsigned int)low;
+                bits[d / 32] |= 1u << (d % 32);
+            }
+            unsigned int w;
+            for (w = 0; w < words; ++w)
+            {
+                unsigned int b;
+                for (b = bits[w]; b != 0; b &= b - 1)
+                    ng_plot_span_add(&spans, low + (int)(w * 32) +
+                                             __builtin_ctz(b));
+            }
+        }
+        else
+        {
+            for (k = first; k < i; ++k)
+                ys[k - first] = p[k].y;
+            qsort(ys, i - first, sizeof(int), ng_plot_compare_y);
+            for (k = 0; k < i - first; ++k)
+                ng_plot_span_add(&spans, ys[k]);
+        }
+        ng_plot_span_end(&spans);
+    }
+    job->result_counts[chunk] = spans.count;
+}
+
+void ng_plot_span_add(ng_plot_spans* spans, int y)
+{
+    if (spans->open && y - spans->y1 <= spans->gap)
+    {
+        spans->y1 = y;
+        return;
+    }
+    ng_plot_span_end(spans);
+    spans->y0 = y;
+    spans->y1 = y;
+    spans->open = 1;
+}
+
+void ng_plot_span_end(ng_plot_spans* spans)
+{
+    if (spans->open)
+        spans->out[spans->count++] =
+            (ng_rect){ spans->x, spans->y0, spans->x, spans->y1, 0 };
+    spans->open = 0;
+}
+
+// the scratch arrays persist between calls and only grow
+int ng_plot_reserve(int count, size_t item)
+{
+    int chunks = (count + NG_PLOT_CHUNK - 1) / NG_PLOT_CHUNK;
+    if ((size_t)count * item > ng_plot_buffer_size)
+    {
+        void* buffer = realloc(ng_plot_buffer, (size_t)count * item);
+        if (buffer == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+        ng_plot_buffer = buffer;
+        ng_plot_buffer_size = (size_t)count * item;
+    }
+    if (count > ng_plot_ys_capacity)
+    {
+        int* ys = realloc(ng_plot_ys, count * sizeof(int));
+        if (ys == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+        ng_plot_ys = ys;
+        ng_plot_ys_capacity = count;
+    }
+    if (count > ng_plot_bits_capacity)
+    {
+        unsigned int* bits = realloc(ng_plot_bits,
+                                     count * sizeof(unsigned int));
+        if (bits == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+        ng_plot_bits = bits;
+        ng_plot_bits_capacity = count;
+    }
+    if (chunks > ng_plot_counts_capacity)
+    {
+        int* counts = realloc(ng_plot_counts, chunks * sizeof(int));
+        if (counts == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+        ng_plot_counts = counts;
+        ng_plot_counts_capacity = chunks;
+    }
+    return 1;
+}
+
+int ng_plot_compare_y(const void* a, const void* b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
+    return x < y ? -1 : x > y;
+}
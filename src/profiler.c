@@ -0,0 +1,224 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NG_PROFILE_FRAMES 512
+
+/* overlay graph: one bar per frame, 1 ms is NG_PROFILE_PIXELS_PER_MS
+   pixels high and a line marks 60 Hz */
+#define NG_PROFILE_GRAPH_FRAMES 128
+#define NG_PROFILE_BAR_WIDTH 2
+#define NG_PROFILE_PIXELS_PER_MS 3
+#define NG_PROFILE_MARGIN 4
+
+/* with a render thread, updates are counted on the logic thread and
+   everything else on the render thread, which ends the frames; the
+   mutex guards the update counts and the kept frames */
+static ng_frame_stats ng_profile_frames[NG_PROFILE_FRAMES];
+static int ng_profile_count;
+static ng_frame_stats ng_profile_current;
+static int ng_profile_last_pipeline = -1;
+static GLenum ng_profile_last_mode;
+static GLfloat ng_profile_last_line_width;
+static _Thread_local int ng_profile_paused;
+static int ng_profile_overlay;
+static pthread_mutex_t ng_profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void ng_profile_write_at_exit();
+
+static const char* ng_profile_csv_path;
+
+void ng_profile_init()
+{
+    if (getenv("NG_PROFILE") != NULL)
+        ng_profile_overlay = atoi(getenv("NG_PROFILE"));
+    ng_profile_csv_path = getenv("NG_PROFILE_CSV");
+    if (ng_profile_csv_path != NULL)
+        atexit(ng_profile_write_at_exit);
+}
+
+void ng_profile_write_at_exit()
+{
+    ng_write_profile_csv(ng_profile_csv_path);
+}
+
+void ng_profile_update(long long us)
+{
+    pthread_mutex_lock(&ng_profile_mutex);
+    ng_profile_current.update_us += us;
+    ++ng_profile_current.updates;
+    pthread_mutex_unlock(&ng_profile_mutex);
+}
+
+// the pause is per thread, the render thread takes it from the commands
+int ng_profile_is_paused()
+{
+    return ng_profile_paused;
+}
+
+void ng_profile_set_paused(int paused)
+{
+    ng_profile_paused = paused;
+}
+
+// a change of pipeline, primitive type or line width between two draws
+// counts as a state change
+void ng_profile_draw(int pipeline, GLenum mode, GLfloat line_width,
+                     int vertices)
+{
+    if (ng_profile_paused)
+        return;
+
+    if (ng_profile_last_pipeline >= 0 &&
+        (pipeline != ng_profile_last_pipeline ||
+         mode != ng_profile_last_mode ||
+         (mode == GL_LINES && line_width != ng_profile_last_line_width)))
+        ++ng_profile_current.state_changes;
+
+    ng_profile_last_pipeline = pipeline;
+    ng_profile_last_mode = mode;
+    ng_profile_last_line_width = line_width;
+    ++ng_profile_current.draw_calls;
+    ng_profile_current.vertices += vertices;
+}
+
+void ng_profile_gl_call(int avoided)
+{
+    if (ng_profile_paused)
+        return;
+    if (avoided)
+        ++ng_profile_current.gl_calls_avoided;
+    else
+        ++ng_profile_current.gl_calls;
+}
+
+void ng_profile_end_frame(long long render_us, long long swap_us)
+{
+    pthread_mutex_lock(&ng_profile_mutex);
+    ng_profile_current.frame = ng_profile_count;
+    ng_profile_current.render_us = render_us;
+    ng_profile_current.swap_us = swap_us;
+    ng_profile_frames[ng_profile_count % NG_PROFILE_FRAMES] = ng_profile_current;
+    ++ng_profile_count;
+
+    memset(&ng_profile_current, 0, sizeof(ng_profile_current));
+    ng_profile_last_pipeline = -1;
+    pthread_mutex_unlock(&ng_profile_mutex);
+}
+
+int ng_get_frame_stats(int frames_ago, ng_frame_stats* stats)
+{
+    int found = 0;
+    pthread_mutex_lock(&ng_profile_mutex);
+    if (frames_ago >= 0 && frames_ago < NG_PROFILE_FRAMES &&
+        frames_ago < ng_profile_count)
+    {
+        *stats = ng_profile_frames[(ng_profile_count - 1 - frames_ago) %
+                                   NG_PROFILE_FRAMES];
+        found = 1;
+    }
+    pthread_mutex_unlock(&ng_profile_mutex);
+    return found;
+}
+
+int ng_write_profile_csv(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "can't open %s\n", path);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ng_profile_mutex);
+    fprintf(f, "frame,update_us,render_us,swap_us,updates,draw_calls,"
+               "vertices,state_changes,gl_calls,gl_calls_avoided\n");
+    int first = ng_profile_count > NG_PROFILE_FRAMES
+        ? ng_profile_count - NG_PROFILE_FRAMES : 0;
+    int i;
+    for (i = first; i < ng_profile_count; ++i)
+    {
+        const ng_frame_stats* s = &ng_profile_frames[i % NG_PROFILE_FRAMES];
+        fprintf(f, "%d,%lld,%lld,%lld,%d,%d,%d,%d,%d,%d\n", s->frame,
+                s->update_us, s->render_us, s->swap_us, s->updates,
+                s->draw_calls, s->vertices, s->state_changes, s->gl_calls,
+                s->gl_calls_avoided);
+    }
+    pthread_mutex_unlock(&ng_profile_mutex);
+
+    fclose(f);
+    return 1;
+}
+
+void ng_set_profiler_overlay(int enabled)
+{
+    ng_profile_overlay = enabled;
+}
+
+// stacked bars of update (green), render (blue) and swap (red) time for
+// the latest frames, with the numbers of the last one above them; the
+// overlay's own draws are not counted
+void ng_profile_draw_overlay()
+{
+    ng_rect rects[NG_PROFILE_GRAPH_FRAMES * 3 + 2];
+    int count = 0;
+    int graph_width = NG_PROFILE_GRAPH_FRAMES * NG_PROFILE_BAR_WIDTH;
+    int graph_height = 34 * NG_PROFILE_PIXELS_PER_MS;
+    int x0 = NG_PROFILE_MARGIN;
+    int y0 = NG_PROFILE_MARGIN;
+    ng_frame_stats last;
+    int i;
+
+    if (!ng_profile_overlay || !ng_get_frame_stats(0, &last))
+        return;
+    ng_batch_flush();
+    ng_profile_paused = 1;
+
+    rects[count++] = (ng_rect){ x0, y0, x0 + graph_width,
+                                y0 + graph_height, 0x000000A0 };
+    for (i = 0; i < NG_PROFILE_GRAPH_FRAMES; ++i)
+    {
+        ng_frame_stats s;
+        if (!ng_get_frame_stats(NG_PROFILE_GRAPH_FRAMES - 1 - i, &s))
+            continue;
+
+        long long parts[3] = { s.update_us, s.render_us, s.swap_us };
+        static const unsigned int colors[3] = {
+            0x40E040FF, 0x4080FFFF, 0xFF5050FF
+        };
+        int x = x0 + i * NG_PROFILE_BAR_WIDTH;
+        int y = y0;
+        int p;
+        for (p = 0; p < 3; ++p)
+        {
+            int h = (int)(parts[p] * NG_PROFILE_PIXELS_PER_MS / 1000);
+            if (y + h > y0 + graph_height)
+                h = y0 + graph_height - y;
+            if (h <= 0)
+                continue;
+            rects[count++] = (ng_rect){ x, y, x + NG_PROFILE_BAR_WIDTH,
+                                        y + h, colors[p] };
+            y += h;
+        }
+    }
+    int y60 = y0 + 1000 * NG_PROFILE_PIXELS_PER_MS / 60;
+    rects[count++] = (ng_rect){ x0, y60, x0 + graph_width, y60 + 1,
+                                0xFFFFFF80 };
+    ng_draw_rectangles(rects, count);
+
+    char text[128];
+    snprintf(text, sizeof(text),
+             "%.2f/%.2f/%.2f ms %d draws %d verts %d states %d/%d gl calls",
+             last.update_us / 1000.0, last.render_us / 1000.0,
+             last.swap_us / 1000.0, last.draw_calls, last.vertices,
+             last.state_changes, last.gl_calls,
+             last.gl_calls + last.gl_calls_avoided);
+    ng_set_color(0xFFFFFFFF);
+    ng_draw_text(x0, y0 + graph_height + NG_PROFILE_MARGIN + NG_FONT_DESCENT,
+                 text);
+    ng_batch_flush();
+
+    ng_profile_paused = 0;
+}
@@ -0,0 +1,208 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* linked programs are kept on disk with glGetProgramBinary, one file per
+   program named after a hash of the driver strings and the sources, so
+   another driver or changed shaders simply miss. A binary the driver
+   refuses, or a cache that can't be read or written, only means the
+   program is compiled from source. */
+#define NG_PROGRAM_CACHE_MAGIC "NGPB"
+#define NG_PROGRAM_CACHE_VERSION 1
+
+typedef struct
+{
+    char magic[4];
+    unsigned int version;
+    unsigned long long key;
+    unsigned int format;
+    unsigned int length;
+} ng_program_header;
+
+static int ng_program_cache_path(unsigned long long key, char* path,
+                                 size_t size, int create);
+static unsigned long long ng_program_hash(unsigned long long hash,
+                                          const char* text);
+
+static const char* ng_program_cache_dir;
+static int ng_program_cache_set;
+static int ng_program_cache_created;
+
+void ng_set_program_cache(const char* dir)
+{
+    ng_program_cache_dir = dir;
+    ng_program_cache_set = 1;
+}
+
+// the key covers everything the binary depends on
+unsigned long long ng_program_key(const char* const* vs_sources,
+                                  const char* const* fs_sources, int sources,
+                                  const char* const* attributes, int count)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    int i;
+    hash = ng_program_hash(hash, (const char*)glGetString(GL_VENDOR));
+    hash = ng_program_hash(hash, (const char*)glGetString(GL_RENDERER));
+    hash = ng_program_hash(hash, (const char*)glGetString(GL_VERSION));
+    for (i = 0; i < sources; ++i)
+    {
+        hash = ng_program_hash(hash, vs_sources[i]);
+        hash = ng_program_hash(hash, fs_sources[i]);
+    }
+    for (i = 0; i < count; ++i)
+        hash = ng_program_hash(hash, attributes[i]);
+    return hash;
+}
+
+// returns the linked program, 0 on a miss
+GLuint ng_program_cache_load(unsigned long long key)
+{
+    char path[1024];
+    ng_program_header header;
+    if (!ng_program_cache_path(key, path, sizeof(path), 0))
+        return 0;
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+
+    void* binary = NULL;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, NG_PROGRAM_CACHE_MAGIC, 4) == 0 &&
+        header.version == NG_PROGRAM_CACHE_VERSION && header.key == key)
+    {
+        binary = malloc(header.length > 0 ? header.length : 1);
+        if (binary != NULL &&
+            fread(binary, 1, header.length, file) != header.length)
+        {
+            free(binary);
+            binary = NULL;
+        }
+    }
+    fclose(file);
+    if (binary == NULL)
+        return 0;
+
+    // drivers refuse binaries from other builds of themselves
+    GLint result = GL_FALSE;
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary, header.length);
+    free(binary);
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    if (!result)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+void ng_program_cache_save(unsigned long long key, GLuint program)
+{
+    char path[1024];
+    char temporary[1040];
+    ng_program_header header;
+    GLint length = 0;
+    if (!ng_program_cache_path(key, path, sizeof(path), 1))
+        return;
+
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    void* binary = malloc(length);
+    if (binary == NULL)
+        return;
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary);
+
+    memcpy(header.magic, NG_PROGRAM_CACHE_MAGIC, 4);
+    header.version = NG_PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = (unsigned int)written;
+
+    // another process starting at the same time never sees half a file
+    snprintf(temporary, sizeof(temporary), "%s.%ld", path, (long)getpid());
+    FILE* file = fopen(temporary, "wb");
+    if (file == NULL)
+    {
+        free(binary);
+        return;
+    }
+    int ok = written > 0 &&
+             fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(binary, 1, written, file) == (size_t)written;
+    ok &= fclose(file) == 0;
+    free(binary);
+    if (!ok || rename(temporary, path) != 0)
+        remove(temporary);
+}
+
+int ng_program_cache_available()
+{
+    GLint formats = 0;
+    if (ng_backend == NG_BACKEND_SOFTWARE || !GLEW_ARB_get_program_binary)
+        return 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// NG_PROGRAM_CACHE or ng_set_program_cache, else the user's cache
+// directory; an empty directory turns the cache off. The directory is
+// made by the first save that wants it, loads only miss without it
+int ng_program_cache_path(unsigned long long key, char* path, size_t size,
+                          int create)
+{
+    const char* dir = ng_program_cache_dir;
+    const char* home = getenv("HOME");
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    char fallback[1024];
+    char parent[1024] = "";
+
+    if (!ng_program_cache_set && getenv("NG_PROGRAM_CACHE") != NULL)
+        dir = getenv("NG_PROGRAM_CACHE");
+    else if (!ng_program_cache_set)
+    {
+        if (xdg != NULL && xdg[0] != '\0')
+            snprintf(fallback, sizeof(fallback), "%s/noobgraphics", xdg);
+        else if (home != NULL && home[0] != '\0')
+        {
+            snprintf(parent, sizeof(parent), "%s/.cache", home);
+            snprintf(fallback, sizeof(fallback), "%s/.cache/noobgraphics", home);
+        }
+        else
+            return 0;
+        dir = fallback;
+    }
+    if (dir == NULL || dir[0] == '\0')
+        return 0;
+
+    if (create && !ng_program_cache_created)
+    {
+        if (parent[0] != '\0')
+            mkdir(parent, 0755);
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+            return 0;
+        ng_program_cache_created = 1;
+    }
+    return snprintf(path, size, "%s/%016llx.bin", dir, key) < (int)size;
+}
+
+// 64 bit FNV-1a, the terminator included so "ab" "c" and "a" "bc" differ
+unsigned long long ng_program_hash(unsigned long long hash, const char* text)
+{
+    if (text == NULL)
+        text = "";
+    do
+    {
+        hash ^= (unsigned char)*text;
+        hash *= 1099511628211ull;
+    } while (*text++ != '\0');
+    return hash;
+}
@@ -0,0 +1,672 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define NG_SOFT_TILE_SIZE 64
+
+#define NG_SOFT_TRIANGLE 0
+#define NG_SOFT_LINE 1
+#define NG_SOFT_TEXT 2
+#define NG_SOFT_RECTANGLE 3
+#define NG_SOFT_QUAD 4
+#define NG_SOFT_SPRITE 5
+
+/* pixel rectangle [x0, x1) x [y0, y1) in GL orientation (y = 0 at the bottom) */
+typedef struct
+{
+    int x0, y0, x1, y1;
+} ng_soft_rect;
+
+/* one primitive recorded for the tiled mode; first indexes
+   ng_soft_vertices for geometry and ng_soft_text_pool for strings, width
+   is the line width or the atlas page of a sprite */
+typedef struct
+{
+    int type;
+    int first;
+    int width;
+    ng_soft_rect bounds;
+} ng_soft_prim;
+
+typedef struct
+{
+    int* prims;
+    int size;
+    int capacity;
+} ng_soft_bin;
+
+static void ng_soft_span(const ng_soft_rect* clip, int x0, int x1, int y,
+                         const GLubyte* color);
+static void ng_soft_triangle(const ng_soft_rect* clip, const ng_vertex* a,
+                             const ng_vertex* b, const ng_vertex* c);
+static void ng_soft_line(const ng_soft_rect* clip, const ng_vertex* a,
+                         const ng_vertex* b, int width);
+static void ng_soft_text(const ng_soft_rect* clip, int x, int y,
+                         const char* text, const GLubyte* color);
+static void ng_soft_fill_rect(const ng_soft_rect* clip, const GLubyte* color);
+static int ng_soft_is_rectangle(const ng_vertex* v);
+static void ng_soft_rectangle(const ng_soft_rect* clip, const ng_vertex* v);
+static void ng_soft_quad(const ng_soft_rect* clip, const ng_vertex* v);
+static int ng_soft_quad_type(const ng_vertex* v, int page);
+static void ng_soft_sprite(const ng_soft_rect* clip, const ng_vertex* v,
+                           int page);
+static float ng_soft_edge_x(const ng_vertex* a, const ng_vertex* b, float y);
+static int ng_soft_texel(float t, int size);
+static int ng_soft_first_center(float x);
+static int ng_soft_record(int type, int first, int width, ng_soft_rect bounds);
+static void ng_soft_run_prim(const ng_soft_rect* clip, const ng_soft_prim* p);
+static void ng_soft_render_tile(int tile, void* ctx);
+
+static GLubyte* ng_soft_pixels;
+static int ng_soft_width;
+static int ng_soft_height;
+static ng_soft_rect ng_soft_screen;
+// the font atlas the GL backends use, for glyph quads recorded on page 0
+static GLubyte* ng_soft_font;
+
+/* tiled mode: the frame is recorded, binned and rasterized in parallel
+   by ng_soft_present(); each tile replays its primitives in submission
+   order, so the output matches the immediate mode bit for bit */
+static int ng_soft_tiled;
+static int ng_soft_clear_pending;
+static int ng_soft_tiles_x;
+static int ng_soft_tiles_y;
+static ng_soft_bin* ng_soft_bins;
+static ng_soft_prim* ng_soft_prims;
+static int ng_soft_prims_size;
+static int ng_soft_prims_capacity;
+static ng_vertex* ng_soft_vertices;
+static int ng_soft_vertices_size;
+static int ng_soft_vertices_capacity;
+static char* ng_soft_text_pool;
+static int ng_soft_text_size;
+static int ng_soft_text_capacity;
+
+int ng_soft_init(int width, int height, int threads)
+{
+    if (width <= 0) width = 1;
+    if (height <= 0) height = 1;
+
+    ng_soft_pixels = malloc((size_t)width * height * 4);
+    ng_soft_font = malloc(NG_FONT_ATLAS_WIDTH * NG_FONT_ATLAS_HEIGHT * 4);
+    if (ng_soft_pixels == NULL || ng_soft_font == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+
+    ng_soft_width = width;
+    ng_soft_height = height;
+    ng_soft_screen.x0 = 0;
+    ng_soft_screen.y0 = 0;
+    ng_soft_screen.x1 = width;
+    ng_soft_screen.y1 = height;
+    ng_font_bake(ng_soft_font);
+    ng_spans_init();
+
+    if (!ng_pool_init(threads))
+        return 0;
+
+    ng_soft_tiled = ng_pool_threads_count() > 1;
+    if (ng_soft_tiled)
+    {
+        ng_soft_tiles_x = (width + NG_SOFT_TILE_SIZE - 1) / NG_SOFT_TILE_SIZE;
+        ng_soft_tiles_y = (height + NG_SOFT_TILE_SIZE - 1) / NG_SOFT_TILE_SIZE;
+        ng_soft_bins = calloc((size_t)ng_soft_tiles_x * ng_soft_tiles_y,
+                              sizeof(ng_soft_bin));
+        if (ng_soft_bins == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+    }
+
+    ng_soft_clear();
+    ng_soft_present();
+    return 1;
+}
+
+void ng_soft_free()
+{
+    int i;
+    ng_pool_free();
+    for (i = 0; ng_soft_bins != NULL && i < ng_soft_tiles_x * ng_soft_tiles_y; ++i)
+        free(ng_soft_bins[i].prims);
+    free(ng_soft_bins);
+    free(ng_soft_prims);
+    free(ng_soft_vertices);
+    free(ng_soft_text_pool);
+    free(ng_soft_pixels);
+    free(ng_soft_font);
+    ng_soft_bins = NULL;
+    ng_soft_prims = NULL;
+    ng_soft_vertices = NULL;
+    ng_soft_text_pool = NULL;
+    ng_soft_pixels = NULL;
+    ng_soft_font = NULL;
+}
+
+void ng_soft_clear()
+{
+    static const GLubyte black[4] = { 0, 0, 0, 255 };
+    if (ng_soft_tiled)
+        ng_soft_clear_pending = 1;
+    else
+        ng_soft_fill_rect(&ng_soft_screen, black);
+}
+
+unsigned char* ng_soft_get_pixels(int* width, int* height)
+{
+    *width = ng_soft_width;
+    *height = ng_soft_height;
+    return ng_soft_pixels;
+}
+
+void ng_soft_draw(GLenum mode, const ng_vertex* v, int count, GLfloat line_width,
+                  int page)
+{
+    int i;
+    int width = (int)(line_width + 0.5f);
+    if (width < 1)
+        width = 1;
+
+    if (!ng_soft_tiled)
+    {
+        if (mode == GL_TRIANGLES)
+        {
+            for (i = 0; i + 2 < count; i += 3)
+                ng_soft_triangle(&ng_soft_screen, v + i, v + i + 1, v + i + 2);
+        }
+        else if (mode == NG_QUADS)
+        {
+            for (i = 0; i + 3 < count; i += 4)
+            {
+                int type = ng_soft_quad_type(v + i, page);
+                if (type == NG_SOFT_SPRITE)
+                    ng_soft_sprite(&ng_soft_screen, v + i, page);
+                else if (type == NG_SOFT_RECTANGLE)
+                    ng_soft_rectangle(&ng_soft_screen, v + i);
+                else
+                    ng_soft_quad(&ng_soft_screen, v + i);
+            }
+        }
+        else if (mode == GL_LINES)
+        {
+            for (i = 0; i + 1 < count; i += 2)
+                ng_soft_line(&ng_soft_screen, v + i, v + i + 1, width);
+        }
+        return;
+    }
+
+    ng_vertex* dst = ng_grow(ng_soft_vertices, &ng_soft_vertices_capacity,
+                             ng_soft_vertices_size + count, sizeof(ng_vertex));
+    if (dst == NULL)
+        return;
+    ng_soft_vertices = dst;
+    memcpy(dst + ng_soft_vertices_size, v, count * sizeof(ng_vertex));
+
+    int pad = mode == GL_LINES ? width : 1;
+    int step;
+    for (i = 0; i < count; i += step)
+    {
+        const ng_vertex* p = v + i;
+        int type = NG_SOFT_LINE;
+        step = 2;
+        if (mode == GL_TRIANGLES)
+        {
+            type = NG_SOFT_TRIANGLE;
+            step = 3;
+        }
+        else if (mode == NG_QUADS)
+        {
+            type = i + 3 < count ? ng_soft_quad_type(p, page) : NG_SOFT_QUAD;
+            step = 4;
+        }
+        if (i + step > count)
+            break;
+
+        float x0 = p[0].x, x1 = p[0].x, y0 = p[0].y, y1 = p[0].y;
+        int j;
+        for (j = 1; j < step; ++j)
+        {
+            if (p[j].x < x0) x0 = p[j].x;
+            if (p[j].x > x1) x1 = p[j].x;
+            if (p[j].y < y0) y0 = p[j].y;
+            if (p[j].y > y1) y1 = p[j].y;
+        }
+
+        ng_soft_rect bounds;
+        bounds.x0 = (int)floorf(x0) - pad;
+        bounds.y0 = (int)floorf(y0) - pad;
+        bounds.x1 = (int)ceilf(x1) + pad;
+        bounds.y1 = (int)ceilf(y1) + pad;
+        if (!ng_soft_record(type, ng_soft_vertices_size + i,
+                            type == NG_SOFT_SPRITE ? page : width, bounds))
+            break;
+    }
+    ng_soft_vertices_size += count;
+}
+
+void ng_soft_draw_text(int x, int y, const char* text, const GLubyte* color)
+{
+    if (!ng_soft_tiled)
+    {
+        ng_soft_text(&ng_soft_screen, x, y, text, color);
+        return;
+    }
+
+    // the color goes first, then the position and the string
+    int len = (int)strlen(text);
+    int size = 4 + 2 * sizeof(int) + len + 1;
+    char* dst = ng_grow(ng_soft_text_pool, &ng_soft_text_capacity,
+                        ng_soft_text_size + size, 1);
+    if (dst == NULL)
+        return;
+    ng_soft_text_pool = dst;
+    dst += ng_soft_text_size;
+    memcpy(dst, color, 4);
+    memcpy(dst + 4, &x, sizeof(int));
+    memcpy(dst + 4 + sizeof(int), &y, sizeof(int));
+    memcpy(dst + 4 + 2 * sizeof(int), text, len + 1);
+
+    ng_soft_rect bounds;
+    bounds.x0 = x;
+    bounds.y0 = y - NG_FONT_DESCENT;
+    bounds.x1 = x + len * NG_FONT_WIDTH;
+    bounds.y1 = y - NG_FONT_DESCENT + NG_FONT_HEIGHT;
+    if (ng_soft_record(NG_SOFT_TEXT, ng_soft_text_size, 0, bounds))
+        ng_soft_text_size += size;
+}
+
+// finishes the frame: in tiled mode bins everything recorded since the
+// last call and rasterizes the tiles on the thread pool
+void ng_soft_present()
+{
+    if (!ng_soft_tiled)
+        return;
+
+    int i, tx, ty;
+    for (i = 0; i < ng_soft_prims_size; ++i)
+    {
+        ng_soft_rect b = ng_soft_prims[i].bounds;
+        if (b.x0 < 0) b.x0 = 0;
+        if (b.y0 < 0) b.y0 = 0;
+        if (b.x1 > ng_soft_width) b.x1 = ng_soft_width;
+        if (b.y1 > ng_soft_height) b.y1 = ng_soft_height;
+        if (b.x0 >= b.x1 || b.y0 >= b.y1)
+            continue;
+
+        for (ty = b.y0 / NG_SOFT_TILE_SIZE; ty <= (b.y1 - 1) / NG_SOFT_TILE_SIZE; ++ty)
+        {
+            for (tx = b.x0 / NG_SOFT_TILE_SIZE; tx <= (b.x1 - 1) / NG_SOFT_TILE_SIZE; ++tx)
+            {
+                ng_soft_bin* bin = &ng_soft_bins[ty * ng_soft_tiles_x + tx];
+                int* prims = ng_grow(bin->prims, &bin->capacity,
+                                     bin->size + 1, sizeof(int));
+                if (prims == NULL)
+                    continue;
+                bin->prims = prims;
+                bin->prims[bin->size++] = i;
+            }
+        }
+    }
+
+    ng_pool_run(ng_soft_tiles_x * ng_soft_tiles_y, ng_soft_render_tile, NULL);
+
+    for (i = 0; i < ng_soft_tiles_x * ng_soft_tiles_y; ++i)
+        ng_soft_bins[i].size = 0;
+    ng_soft_prims_size = 0;
+    ng_soft_vertices_size = 0;
+    ng_soft_text_size = 0;
+    ng_soft_clear_pending = 0;
+}
+
+int ng_soft_record(int type, int first, int width, ng_soft_rect bounds)
+{
+    ng_soft_prim* prims = ng_grow(ng_soft_prims, &ng_soft_prims_capacity,
+                                  ng_soft_prims_size + 1, sizeof(ng_soft_prim));
+    if (prims == NULL)
+        return 0;
+    ng_soft_prims = prims;
+
+    ng_soft_prim* p = &ng_soft_prims[ng_soft_prims_size++];
+    p->type = type;
+    p->first = first;
+    p->width = width;
+    p->bounds = bounds;
+    return 1;
+}
+
+void ng_soft_render_tile(int tile, void* ctx)
+{
+    static const GLubyte black[4] = { 0, 0, 0, 255 };
+    const ng_soft_bin* bin = &ng_soft_bins[tile];
+    ng_soft_rect clip;
+    int i;
+    (void)ctx;
+
+    clip.x0 = (tile % ng_soft_tiles_x) * NG_SOFT_TILE_SIZE;
+    clip.y0 = (tile / ng_soft_tiles_x) * NG_SOFT_TILE_SIZE;
+    clip.x1 = clip.x0 + NG_SOFT_TILE_SIZE;
+    clip.y1 = clip.y0 + NG_SOFT_TILE_SIZE;
+    if (clip.x1 > ng_soft_width) clip.x1 = ng_soft_width;
+    if (clip.y1 > ng_soft_height) clip.y1 = ng_soft_height;
+
+    if (ng_soft_clear_pending)
+        ng_soft_fill_rect(&clip, black);
+    for (i = 0; i < bin->size; ++i)
+        ng_soft_run_prim(&clip, &ng_soft_prims[bin->prims[i]]);
+}
+
+void ng_soft_run_prim(const ng_soft_rect* clip, const ng_soft_prim* p)
+{
+    const ng_vertex* v = ng_soft_vertices + p->first;
+    const char* t = ng_soft_text_pool + p->first;
+    int x, y;
+
+    switch (p->type)
+    {
+    case NG_SOFT_TRIANGLE:
+        ng_soft_triangle(clip, v, v + 1, v + 2);
+        break;
+    case NG_SOFT_RECTANGLE:
+        ng_soft_rectangle(clip, v);
+        break;
+    case NG_SOFT_QUAD:
+        ng_soft_quad(clip, v);
+        break;
+    case NG_SOFT_SPRITE:
+        ng_soft_sprite(clip, v, p->width);
+        break;
+    case NG_SOFT_LINE:
+        ng_soft_line(clip, v, v + 1, p->width);
+        break;
+    case NG_SOFT_TEXT:
+        memcpy(&x, t + 4, sizeof(int));
+        memcpy(&y, t + 4 + sizeof(int), sizeof(int));
+        ng_soft_text(clip, x, y, t + 4 + 2 * sizeof(int), (const GLubyte*)t);
+        break;
+    }
+}
+
+void ng_soft_fill_rect(const ng_soft_rect* clip, const GLubyte* color)
+{
+    int y;
+    for (y = clip->y0; y < clip->y1; ++y)
+        ng_soft_span(clip, clip->x0, clip->x1, y, color);
+}
+
+// fills pixels [x0, x1) of GL row y (counted from the bottom) using
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+void ng_soft_span(const ng_soft_rect* clip, int x0, int x1, int y,
+                  const GLubyte* color)
+{
+    if (y < clip->y0 || y >= clip->y1)
+        return;
+    if (x0 < clip->x0) x0 = clip->x0;
+    if (x1 > clip->x1) x1 = clip->x1;
+    if (x0 >= x1)
+        return;
+
+    unsigned int a = color[3];
+    if (a == 0)
+        return;
+
+    GLubyte* p = ng_soft_pixels +
+        ((size_t)(ng_soft_height - 1 - y) * ng_soft_width + x0) * 4;
+    if (a == 255)
+        ng_span_fill(p, x1 - x0, color);
+    else
+        ng_span_blend(p, x1 - x0, color);
+}
+
+// an axis-aligned quad in one color, as ng_draw_rectangle emits it
+int ng_soft_is_rectangle(const ng_vertex* v)
+{
+    return v[1].x == v[0].x && v[1].y == v[2].y &&
+           v[3].x == v[2].x && v[3].y == v[0].y &&
+           memcmp(v[0].color, v[2].color, 4) == 0;
+}
+
+// same pixels as rasterizing both triangles, as one span per row
+void ng_soft_rectangle(const ng_soft_rect* clip, const ng_vertex* v)
+{
+    float x0 = v[0].x < v[2].x ? v[0].x : v[2].x;
+    float x1 = v[0].x < v[2].x ? v[2].x : v[0].x;
+    float y0 = v[0].y < v[2].y ? v[0].y : v[2].y;
+    float y1 = v[0].y < v[2].y ? v[2].y : v[0].y;
+
+    int xs = ng_soft_first_center(x0);
+    int xe = ng_soft_first_center(x1);
+    int y = ng_soft_first_center(y0);
+    int y_end = ng_soft_first_center(y1);
+    if (y < clip->y0) y = clip->y0;
+    if (y_end > clip->y1) y_end = clip->y1;
+
+    for (; y < y_end; ++y)
+        ng_soft_span(clip, xs, xe, y, v[0].color);
+}
+
+void ng_soft_quad(const ng_soft_rect* clip, const ng_vertex* v)
+{
+    ng_soft_triangle(clip, v, v + 1, v + 2);
+    ng_soft_triangle(clip, v, v + 2, v + 3);
+}
+
+// solid quads sample the white texels, which every page has; the
+// others on page 0 are glyphs
+int ng_soft_quad_type(const ng_vertex* v, int page)
+{
+    if (!ng_soft_is_rectangle(v))
+        return NG_SOFT_QUAD;
+    if (page >= 0 && (v[0].u != NG_WHITE_U || v[0].v != NG_WHITE_V))
+        return NG_SOFT_SPRITE;
+    return NG_SOFT_RECTANGLE;
+}
+
+// an image on a rectangle, sampled at the pixel centers like
+// GL_NEAREST and multiplied by the vertex color
+void ng_soft_sprite(const ng_soft_rect* clip, const ng_vertex* v, int page)
+{
+    int width = NG_FONT_ATLAS_WIDTH;
+    int height = NG_FONT_ATLAS_HEIGHT;
+    const GLubyte* texels = page == 0 ? ng_soft_font
+                                      : ng_page_pixels(page, &width, &height);
+    if (texels == NULL)
+        return;
+
+    float x0 = v[0].x < v[2].x ? v[0].x : v[2].x;
+    float x1 = v[0].x < v[2].x ? v[2].x : v[0].x;
+    float y0 = v[0].y < v[2].y ? v[0].y : v[2].y;
+    float y1 = v[0].y < v[2].y ? v[2].y : v[0].y;
+    int xs = ng_soft_first_center(x0);
+    int xe = ng_soft_first_center(x1);
+    int ys = ng_soft_first_center(y0);
+    int ye = ng_soft_first_center(y1);
+    if (xs < clip->x0) xs = clip->x0;
+    if (xe > clip->x1) xe = clip->x1;
+    if (ys < clip->y0) ys = clip->y0;
+    if (ye > clip->y1) ye = clip->y1;
+
+    // texels per pixel; every pixel is computed from the first vertex so
+    // tiles agree with the whole screen
+    float du = (v[2].u - v[0].u) * width / (v[2].x - v[0].x);
+    float dv = (v[2].v - v[0].v) * height / (v[2].y - v[0].y);
+    float u0 = v[0].u * width;
+    float v0 = v[0].v * height;
+    const GLubyte* tint = v[0].color;
+    int x, y;
+
+    for (y = ys; y < ye; ++y)
+    {
+        int ty = ng_soft_texel(v0 + (y + 0.5f - v[0].y) * dv, height);
+        const GLubyte* row = texels + (size_t)ty * width * 4;
+        GLubyte* p = ng_soft_pixels +
+            ((size_t)(ng_soft_height - 1 - y) * ng_soft_width + xs) * 4;
+
+        for (x = xs; x < xe; ++x, p += 4)
+        {
+            int tx = ng_soft_texel(u0 + (x + 0.5f - v[0].x) * du, width);
+            // tinted, then blended as ng_span_blend does one pixel
+            const GLubyte* t = row + tx * 4;
+            unsigned int a = (t[3] * tint[3] + 127) / 255;
+            if (a == 0)
+                continue;
+
+            unsigned int ia = 255 - a;
+            int k;
+            for (k = 0; k < 3; ++k)
+            {
+                unsigned int c = (t[k] * tint[k] + 127) / 255;
+                unsigned int s = p[k] * ia + c * a + 128;
+                p[k] = (GLubyte)((s + (s >> 8)) >> 8);
+            }
+            unsigned int s = p[3] * ia + a * a + 128;
+            p[3] = (GLubyte)((s + (s >> 8)) >> 8);
+        }
+    }
+}
+
+// the texel at t, clamped to the edge; truncating is flooring for
+// everything that isn't clamped
+int ng_soft_texel(float t, int size)
+{
+    if (t < 1.0f)
+        return 0;
+    if (t >= (float)size)
+        return size - 1;
+    return (int)t;
+}
+
+// index of the first pixel whose center is at or after x
+int ng_soft_first_center(float x)
+{
+    return (int)ceilf(x - 0.5f);
+}
+
+float ng_soft_edge_x(const ng_vertex* a, const ng_vertex* b, float y)
+{
+    return a->x + (y - a->y) * (b->x - a->x) / (b->y - a->y);
+}
+
+// covers pixel centers inside the triangle; spans are half-open on both
+// axes, so triangles sharing an edge never touch the same pixel twice
+void ng_soft_triangle(const ng_soft_rect* clip, const ng_vertex* a,
+                      const ng_vertex* b, const ng_vertex* c)
+{
+    const ng_vertex* t;
+    if (b->y < a->y) { t = a; a = b; b = t; }
+    if (c->y < b->y) { t = b; b = c; c = t; }
+    if (b->y < a->y) { t = a; a = b; b = t; }
+
+    if (a->y == c->y)
+        return;
+
+    int y = ng_soft_first_center(a->y);
+    int y_end = ng_soft_first_center(c->y);
+    if (y < clip->y0) y = clip->y0;
+    if (y_end > clip->y1) y_end = clip->y1;
+
+    for (; y < y_end; ++y)
+    {
+        float yc = y + 0.5f;
+        float xl = ng_soft_edge_x(a, c, yc);
+        float xr = yc < b->y ? ng_soft_edge_x(a, b, yc)
+                             : ng_soft_edge_x(b, c, yc);
+        if (xr < xl)
+        {
+            float tx = xl;
+            xl = xr;
+            xr = tx;
+        }
+        ng_soft_span(clip, ng_soft_first_center(xl), ng_soft_first_center(xr),
+                     y, a->color);
+    }
+}
+
+// aliased wide line as in the GL spec: every column (or row, for
+// y-major lines) of the segment gets a run of width pixels
+void ng_soft_line(const ng_soft_rect* clip, const ng_vertex* a,
+                  const ng_vertex* b, int width)
+{
+    float dx = b->x - a->x;
+    float dy = b->y - a->y;
+    int half = (width - 1) / 2;
+
+    if (fabsf(dx) >= fabsf(dy))
+    {
+        if (dx == 0.0f)
+            return;
+        if (dx < 0.0f)
+        {
+            const ng_vertex* t = a;
+            a = b;
+            b = t;
+        }
+        int x = ng_soft_first_center(a->x);
+        int x_end = ng_soft_first_center(b->x);
+        if (x < clip->x0) x = clip->x0;
+        if (x_end > clip->x1) x_end = clip->x1;
+        for (; x < x_end; ++x)
+        {
+            float yc = a->y + (x + 0.5f - a->x) * (b->y - a->y) / (b->x - a->x);
+            int y = (int)floorf(yc) - half;
+            int i;
+            for (i = 0; i < width; ++i)
+                ng_soft_span(clip, x, x + 1, y + i, a->color);
+        }
+    }
+    else
+    {
+        if (dy < 0.0f)
+        {
+            const ng_vertex* t = a;
+            a = b;
+            b = t;
+        }
+        int y = ng_soft_first_center(a->y);
+        int y_end = ng_soft_first_center(b->y);
+        if (y < clip->y0) y = clip->y0;
+        if (y_end > clip->y1) y_end = clip->y1;
+        for (; y < y_end; ++y)
+        {
+            float xc = a->x + (y + 0.5f - a->y) * (b->x - a->x) / (b->y - a->y);
+            int x = (int)floorf(xc) - half;
+            ng_soft_span(clip, x, x + width, y, a->color);
+        }
+    }
+}
+
+void ng_soft_text(const ng_soft_rect* clip, int x, int y,
+                  const char* text, const GLubyte* color)
+{
+    for (; *text != '\0'; ++text, x += NG_FONT_WIDTH)
+    {
+        int c = (unsigned char)*text - NG_FONT_FIRST;
+        if (c < 0 || c >= NG_FONT_GLYPHS)
+            continue;
+
+        const unsigned short* rows = ng_font_glyphs[c];
+        int row;
+        for (row = 0; row < NG_FONT_HEIGHT; ++row)
+        {
+            unsigned int bits = rows[row];
+            int i = 0;
+            while (i < NG_FONT_WIDTH)
+            {
+                if (!(bits & (0x8000u >> i)))
+                {
+                    ++i;
+                    continue;
+                }
+                int start = i;
+                while (i < NG_FONT_WIDTH && (bits & (0x8000u >> i)))
+                    ++i;
+                ng_soft_span(clip, x + start, x + i,
+                             y - NG_FONT_DESCENT + row, color);
+            }
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NG_SPANS_X86 1
+#include <immintrin.h>
+#endif
+
+static void ng_span_fill_scalar(GLubyte* p, int n, const GLubyte* color);
+static void ng_span_blend_scalar(GLubyte* p, int n, const GLubyte* color);
+#ifdef NG_SPANS_X86
+static void ng_span_fill_sse2(GLubyte* p, int n, const GLubyte* color);
+static void ng_span_blend_sse2(GLubyte* p, int n, const GLubyte* color);
+static void ng_span_fill_avx2(GLubyte* p, int n, const GLubyte* color);
+static void ng_span_blend_avx2(GLubyte* p, int n, const GLubyte* color);
+#endif
+
+static const ng_span_kernels ng_all_span_kernels[] = {
+    { "scalar", ng_span_fill_scalar, ng_span_blend_scalar },
+#ifdef NG_SPANS_X86
+    { "sse2", ng_span_fill_sse2, ng_span_blend_sse2 },
+    { "avx2", ng_span_fill_avx2, ng_span_blend_avx2 },
+#endif
+};
+
+static int ng_span_kernels_supported;
+
+ng_span_func ng_span_fill = ng_span_fill_scalar;
+ng_span_func ng_span_blend = ng_span_blend_scalar;
+
+// picks the widest kernel set the CPU runs, NG_SIMD=scalar|sse2|avx2
+// narrows the choice
+void ng_spans_init()
+{
+    int count = 1;
+#ifdef NG_SPANS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        count = 2;
+        if (__builtin_cpu_supports("avx2"))
+            count = 3;
+    }
+#endif
+    ng_span_kernels_supported = count;
+
+    const ng_span_kernels* k = &ng_all_span_kernels[count - 1];
+    const char* env = getenv("NG_SIMD");
+    int i;
+    for (i = 0; env != NULL && i < count; ++i)
+    {
+        if (strcmp(env, ng_all_span_kernels[i].name) == 0)
+            k = &ng_all_span_kernels[i];
+    }
+
+    ng_span_fill = k->fill;
+    ng_span_blend = k->blend;
+}
+
+const ng_span_kernels* ng_get_span_kernels(int* count)
+{
+    if (ng_span_kernels_supported == 0)
+        ng_spans_init();
+    *count = ng_span_kernels_supported;
+    return ng_all_span_kernels;
+}
+
+void ng_span_fill_scalar(GLubyte* p, int n, const GLubyte* color)
+{
+    GLubyte* end = p + (size_t)n * 4;
+    for (; p != end; p += 4)
+        memcpy(p, color, 4);
+}
+
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) on all four channels,
+// rounded the same way by every kernel:
+// v = d * (255 - a) + s * a + 128, result = (v + (v >> 8)) >> 8
+void ng_span_blend_scalar(GLubyte* p, int n, const GLubyte* color)
+{
+    unsigned int a = color[3];
+    unsigned int ia = 255 - a;
+    unsigned int sr = color[0] * a + 128;
+    unsigned int sg = color[1] * a + 128;
+    unsigned int sb = color[2] * a + 128;
+    unsigned int sa = a * a + 128;
+    GLubyte* end = p + (size_t)n * 4;
+    for (; p != end; p += 4)
+    {
+        unsigned int r = p[0] * ia + sr;
+        unsigned int g = p[1] * ia + sg;
+        unsigned int b = p[2] * ia + sb;
+        unsigned int al = p[3] * ia + sa;
+        p[0] = (GLubyte)((r + (r >> 8)) >> 8);
+        p[1] = (GLubyte)((g + (g >> 8)) >> 8);
+        p[2] = (GLubyte)((b + (b >> 8)) >> 8);
+        p[3] = (GLubyte)((al + (al >> 8)) >> 8);
+    }
+}
+
+#ifdef NG_SPANS_X86
+
+__attribute__((target("sse2")))
+void ng_span_fill_sse2(GLubyte* p, int n, const GLubyte* color)
+{
+    int c;
+    memcpy(&c, color, 4);
+    __m128i v = _mm_set1_epi32(c);
+    for (; n >= 4; n -= 4, p += 16)
+        _mm_storeu_si128((__m128i*)p, v);
+    ng_span_fill_scalar(p, n, color);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i ng_blend_sse2(__m128i d, __m128i ia, __m128i s)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia), s);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia), s);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+__attribute__((target("sse2")))
+void ng_span_blend_sse2(GLubyte* p, int n, const GLubyte* color)
+{
+    short a = color[3];
+    __m128i ia = _mm_set1_epi16(255 - a);
+    __m128i s = _mm_setr_epi16(color[0] * a + 128, color[1] * a + 128,
+                               color[2] * a + 128, a * a + 128,
+                               color[0] * a + 128, color[1] * a + 128,
+                               color[2] * a + 128, a * a + 128);
+    for (; n >= 4; n -= 4, p += 16)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)p);
+        _mm_storeu_si128((__m128i*)p, ng_blend_sse2(d, ia, s));
+    }
+    ng_span_blend_scalar(p, n, color);
+}
+
+__attribute__((target("avx2")))
+void ng_span_fill_avx2(GLubyte* p, int n, const GLubyte* color)
+{
+    int c;
+    memcpy(&c, color, 4);
+    __m256i v = _mm256_set1_epi32(c);
+    for (; n >= 16; n -= 16, p += 64)
+    {
+        _mm256_storeu_si256((__m256i*)p, v);
+        _mm256_storeu_si256((__m256i*)(p + 32), v);
+    }
+    for (; n >= 8; n -= 8, p += 32)
+        _mm256_storeu_si256((__m256i*)p, v);
+    ng_span_fill_scalar(p, n, color);
+}
+
+__attribute__((target("avx2")))
+void ng_span_blend_avx2(GLubyte* p, int n, const GLubyte* color)
+{
+    short a = color[3];
+    __m256i zero = _mm256_setzero_si256();
+    __m256i ia = _mm256_set1_epi16(255 - a);
+    short sr = color[0] * a + 128;
+    short sg = color[1] * a + 128;
+    short sb = color[2] * a + 128;
+    short sa = a * a + 128;
+    __m256i s = _mm256_setr_epi16(sr, sg, sb, sa, sr, sg, sb, sa,
+                                  sr, sg, sb, sa, sr, sg, sb, sa);
+    for (; n >= 8; n -= 8, p += 32)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i*)p);
+        // unpack works within 128-bit lanes and packus undoes it the same way
+        __m256i lo = _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia), s);
+        __m256i hi = _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia), s);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        _mm256_storeu_si256((__m256i*)p, _mm256_packus_epi16(lo, hi));
+    }
+    ng_span_blend_sse2(p, n, color);
+}
+
+#endif
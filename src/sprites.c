@@ -0,0 +1,593 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+/* images are packed into pages on shelves: rows of images no taller
+   than the row, filled from left to right, with a pixel of space around
+   each image; the pages' rows go up the screen like GL textures, so an
+   image is stored upside down. A page is emptied when its last image
+   is freed. With a render thread the pages are changed on the logic
+   thread and uploaded on the render thread, under ng_pages_mutex; the
+   array can move when a page is added, so drawing reads the sizes it
+   needs under the lock too. */
+#define NG_PAGE_SIZE 1024
+#define NG_PAGE_PADDING 1
+
+typedef struct
+{
+    int y;
+    int height;
+    int x;
+} ng_shelf;
+
+typedef struct
+{
+    GLubyte* pixels;
+    int width;
+    int height;
+    GLuint texture;
+    int dirty_y0;           // rows [dirty_y0, dirty_y1) wait for upload
+    int dirty_y1;
+    ng_shelf* shelves;
+    int shelves_size;
+    int shelves_capacity;
+    int top;                // the row above the last shelf
+    int images;
+} ng_page;
+
+static int ng_page_place(ng_page* page, int width, int height, int* x, int* y);
+static int ng_page_add(int width, int height);
+static void ng_page_clear(ng_page* page);
+static void ng_page_white(const ng_page* page, int* x, int* y);
+static void ng_upload_white(const ng_page* page);
+static void ng_upload_rows(ng_page* page);
+static int ng_sprite_page(const ng_sprite* sprite, int pages);
+static void ng_sprite_quad(const ng_image* image, const int* page_size,
+                           int x0, int y0, int x1, int y1,
+                           const GLubyte* color);
+
+/* ng_pages[0] stands for the font atlas and stays empty */
+static ng_page* ng_pages;
+static int ng_pages_size = 1;
+static int ng_pages_capacity;
+/* sorting scratch of the calling thread */
+static _Thread_local int* ng_sprite_order;
+static _Thread_local int ng_sprite_order_capacity;
+static _Thread_local int* ng_sprite_page_counts;
+static _Thread_local int* ng_sprite_page_sizes;     // width, height
+static _Thread_local int ng_sprite_pages_capacity;
+static GLuint ng_upload_buffer;
+static GLsizeiptr ng_upload_buffer_size;
+static pthread_mutex_t ng_pages_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ng_image* ng_create_image(const unsigned char* rgba, int width, int height)
+{
+    if (rgba == NULL || width <= 0 || height <= 0)
+    {
+        fprintf(stderr, "ng_create_image: bad size %dx%d\n", width, height);
+        return NULL;
+    }
+
+    ng_image* image = malloc(sizeof(ng_image));
+    if (image == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return NULL;
+    }
+    if (!ng_image_place(image, rgba, width, height))
+    {
+        free(image);
+        return NULL;
+    }
+    return image;
+}
+
+// copies the pixels into the first page with room, or a new one, and
+// makes the image ready
+int ng_image_place(ng_image* image, const unsigned char* rgba, int width,
+                   int height)
+{
+    int w = width + NG_PAGE_PADDING, h = height + NG_PAGE_PADDING;
+    int i;
+    pthread_mutex_lock(&ng_pages_mutex);
+    for (i = 1; i < ng_pages_size; ++i)
+    {
+        if (ng_page_place(&ng_pages[i], w, h, &image->x, &image->y))
+            break;
+    }
+    if (i == ng_pages_size)
+    {
+        i = ng_page_add(w, h);
+        if (i == 0 || !ng_page_place(&ng_pages[i], w, h, &image->x, &image->y))
+        {
+            pthread_mutex_unlock(&ng_pages_mutex);
+            return 0;
+        }
+    }
+
+    ng_page* page = &ng_pages[i];
+    int row;
+    for (row = 0; row < height; ++row)
+    {
+        memcpy(page->pixels + ((size_t)(image->y + height - 1 - row) *
+                               page->width + image->x) * 4,
+               rgba + (size_t)row * width * 4, (size_t)width * 4);
+    }
+    if (page->dirty_y0 == page->dirty_y1 || image->y < page->dirty_y0)
+        page->dirty_y0 = image->y;
+    if (image->y + height > page->dirty_y1)
+        page->dirty_y1 = image->y + height;
+    ++page->images;
+    pthread_mutex_unlock(&ng_pages_mutex);
+
+    image->trace_id = 0;
+    image->page = i;
+    image->width = width;
+    image->height = height;
+    image->state = NG_IMAGE_READY;
+    return 1;
+}
+
+ng_image* ng_create_sub_image(const ng_image* image, int x, int y,
+                              int width, int height)
+{
+    if (image == NULL || image->state != NG_IMAGE_READY ||
+        x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        x + width > image->width || y + height > image->height)
+    {
+        fprintf(stderr, "ng_create_sub_image: region out of the image\n");
+        return NULL;
+    }
+
+    ng_image* sub = malloc(sizeof(ng_image));
+    if (sub == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return NULL;
+    }
+
+    sub->state = NG_IMAGE_READY;
+    sub->trace_id = 0;
+    sub->page = image->page;
+    sub->x = image->x + x;
+    sub->y = image->y + image->height - y - height;
+    sub->width = width;
+    sub->height = height;
+    pthread_mutex_lock(&ng_pages_mutex);
+    ++ng_pages[sub->page].images;
+    pthread_mutex_unlock(&ng_pages_mutex);
+    return sub;
+}
+
+void ng_free_image(ng_image* image)
+{
+    if (image == NULL)
+        return;
+    if (image->state == NG_IMAGE_LOADING)
+    {
+        // the loader frees it when the file arrives
+        image->state = NG_IMAGE_CANCELLED;
+        return;
+    }
+
+    if (ng_trace_recording &&
+        ng_trace_id(image->trace_id, image->trace_session) != 0)
+        ng_trace_ints(NG_TRACE_FREE_IMAGE, 1, image->trace_id);
+    if (image->state == NG_IMAGE_READY)
+    {
+        pthread_mutex_lock(&ng_pages_mutex);
+        ng_page* page = &ng_pages[image->page];
+        if (--page->images == 0)
+            ng_page_clear(page);
+        pthread_mutex_unlock(&ng_pages_mutex);
+    }
+    free(image);
+}
+
+void ng_get_image_size(const ng_image* image, int* width, int* height)
+{
+    int ready = image != NULL && image->state == NG_IMAGE_READY;
+    *width = ready ? image->width : 0;
+    *height = ready ? image->height : 0;
+}
+
+void ng_draw_image(const ng_image* image, int x, int y)
+{
+    if (image != NULL && image->state == NG_IMAGE_READY)
+        ng_draw_image_scaled(image, x, y, x + image->width, y + image->height);
+}
+
+void ng_draw_image_scaled(const ng_image* image, int x0, int y0, int x1, int y1)
+{
+    if (image == NULL || image->state != NG_IMAGE_READY)
+        return;
+    if (ng_trace_recording)
+        ng_trace_ints(NG_TRACE_DRAW_IMAGE, 5, ng_trace_image(image),
+                      x0, y0, x1, y1);
+    int page_size[2];
+    pthread_mutex_lock(&ng_pages_mutex);
+    page_size[0] = ng_pages[image->page].width;
+    page_size[1] = ng_pages[image->page].height;
+    pthread_mutex_unlock(&ng_pages_mutex);
+    ng_sprite_quad(image, page_size, x0, y0, x1, y1, NULL);
+}
+
+// sorted by page with a counting sort, which keeps the order of the
+// sprites on each page; images that aren't ready count as page -1 and
+// are left out, like images placed on a page added after the sizes of
+// the pages were taken
+void ng_draw_sprites(const ng_sprite* sprites, int count)
+{
+    int i;
+    if (count <= 0)
+        return;
+    if (ng_trace_recording)
+        ng_trace_sprites(sprites, count);
+
+    if (count > ng_sprite_order_capacity)
+    {
+        int* order = realloc(ng_sprite_order, count * sizeof(int));
+        if (order == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return;
+        }
+        ng_sprite_order = order;
+        ng_sprite_order_capacity = count;
+    }
+
+    pthread_mutex_lock(&ng_pages_mutex);
+    int pages = ng_pages_size;
+    if (pages + 1 > ng_sprite_pages_capacity)
+    {
+        int* counts = realloc(ng_sprite_page_counts, (pages + 1) * sizeof(int));
+        if (counts != NULL)
+            ng_sprite_page_counts = counts;
+        int* sizes = realloc(ng_sprite_page_sizes, pages * 2 * sizeof(int));
+        if (sizes != NULL)
+            ng_sprite_page_sizes = sizes;
+        if (counts == NULL || sizes == NULL)
+        {
+            pthread_mutex_unlock(&ng_pages_mutex);
+            fprintf(stderr, "out of memory\n");
+            return;
+        }
+        ng_sprite_pages_capacity = pages + 1;
+    }
+    for (i = 1; i < pages; ++i)
+    {
+        ng_sprite_page_sizes[i * 2] = ng_pages[i].width;
+        ng_sprite_page_sizes[i * 2 + 1] = ng_pages[i].height;
+    }
+    pthread_mutex_unlock(&ng_pages_mutex);
+
+    int* counts = ng_sprite_page_counts;
+    memset(counts, 0, (pages + 1) * sizeof(int));
+    for (i = 0; i < count; ++i)
+        ++counts[ng_sprite_page(&sprites[i], pages) + 1];
+    for (i = 1; i <= pages; ++i)
+        counts[i] += counts[i - 1];
+    for (i = 0; i < count; ++i)
+    {
+        int page = ng_sprite_page(&sprites[i], pages);
+        if (page >= 0)
+            ng_sprite_order[counts[page]++] = i;
+    }
+
+    int skipped = counts[0];
+    int drawn = counts[pages - 1];
+    for (i = skipped; i < drawn; ++i)
+    {
+        const ng_sprite* s = &sprites[ng_sprite_order[i]];
+        GLubyte color[4] = {
+            (GLubyte)(s->color >> 24), (GLubyte)(s->color >> 16),
+            (GLubyte)(s->color >> 8), (GLubyte)s->color
+        };
+        ng_sprite_quad(s->image, &ng_sprite_page_sizes[s->image->page * 2],
+                       s->x0, s->y0, s->x1, s->y1, color);
+    }
+}
+
+// uploads the rows changed since the last call; the texture is created
+// on first use, so images can be made before the window exists, and
+// gets only the white corner and the rows of the shelves; the rest is
+// never sampled, so it is left as GL makes it
+GLuint ng_page_texture(int index)
+{
+    pthread_mutex_lock(&ng_pages_mutex);
+    ng_page* page = &ng_pages[index];
+    if (page->texture == 0)
+    {
+        glGenTextures(1, &page->texture);
+        ng_gl_bind_texture(page->texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page->width, page->height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        ng_upload_white(page);
+        // the shelves hold every image placed so far
+        page->dirty_y0 = 0;
+        page->dirty_y1 = page->top;
+    }
+    if (page->dirty_y0 < page->dirty_y1)
+    {
+        ng_gl_bind_texture(page->texture);
+        ng_upload_rows(page);
+        page->dirty_y0 = page->dirty_y1 = 0;
+    }
+    GLuint texture = page->texture;
+    pthread_mutex_unlock(&ng_pages_mutex);
+    return texture;
+}
+
+// the pixels of a page stay where they are, only the array moves
+const GLubyte* ng_page_pixels(int index, int* width, int* height)
+{
+    const GLubyte* pixels = NULL;
+    pthread_mutex_lock(&ng_pages_mutex);
+    if (index > 0 && index < ng_pages_size)
+    {
+        *width = ng_pages[index].width;
+        *height = ng_pages[index].height;
+        pixels = ng_pages[index].pixels;
+    }
+    pthread_mutex_unlock(&ng_pages_mutex);
+    return pixels;
+}
+
+// the pixels stay for the images, only the textures go with the context
+void ng_sprites_free()
+{
+    int i;
+    if (ng_upload_buffer != 0)
+        ng_gl_delete_buffer(ng_upload_buffer);
+    ng_upload_buffer = 0;
+    ng_upload_buffer_size = 0;
+    pthread_mutex_lock(&ng_pages_mutex);
+    for (i = 1; i < ng_pages_size; ++i)
+    {
+        if (ng_pages[i].texture != 0)
+            ng_gl_delete_texture(ng_pages[i].texture);
+        ng_pages[i].texture = 0;
+    }
+    pthread_mutex_unlock(&ng_pages_mutex);
+    ng_sprites_free_scratch();
+}
+
+void ng_sprites_free_scratch()
+{
+    free(ng_sprite_order);
+    free(ng_sprite_page_counts);
+    free(ng_sprite_page_sizes);
+    ng_sprite_order = NULL;
+    ng_sprite_order_capacity = 0;
+    ng_sprite_page_counts = NULL;
+    ng_sprite_page_sizes = NULL;
+    ng_sprite_pages_capacity = 0;
+}
+
+// the shortest shelf the image fits on, or a new one; shelves reaching
+// into the white corner end where it starts
+int ng_page_place(ng_page* page, int width, int height, int* x, int* y)
+{
+    ng_shelf* best = NULL;
+    int white_x, white_y;
+    int i;
+
+    ng_page_white(page, &white_x, &white_y);
+
+    for (i = 0; i < page->shelves_size; ++i)
+    {
+        ng_shelf* s = &page->shelves[i];
+        int end = s->y + s->height > white_y ? white_x : page->width;
+        if (height <= s->height && s->x + width <= end &&
+            (best == NULL || s->height < best->height))
+            best = s;
+    }
+
+    if (best == NULL)
+    {
+        int end = page->top + height > white_y ? white_x : page->width;
+        if (page->top + height > page->height || width > end)
+            return 0;
+
+        ng_shelf* shelves = page->shelves;
+        if (page->shelves_size == page->shelves_capacity)
+        {
+            int capacity = page->shelves_capacity > 0
+                ? page->shelves_capacity * 2 : 16;
+            shelves = realloc(shelves, capacity * sizeof(ng_shelf));
+            if (shelves == NULL)
+            {
+                fprintf(stderr, "out of memory\n");
+                return 0;
+            }
+            page->shelves = shelves;
+            page->shelves_capacity = capacity;
+        }
+        best = &shelves[page->shelves_size++];
+        best->y = page->top;
+        best->height = height;
+        best->x = 0;
+        page->top += height;
+    }
+
+    *x = best->x;
+    *y = best->y;
+    best->x += width;
+    return 1;
+}
+
+// a page of NG_PAGE_SIZE, or larger for an image that doesn't fit
+int ng_page_add(int width, int height)
+{
+    int size = NG_PAGE_SIZE;
+    while (size - size * NG_FONT_WHITE_SIZE / NG_FONT_ATLAS_WIDTH < width ||
+           size - size * NG_FONT_WHITE_SIZE / NG_FONT_ATLAS_HEIGHT < height)
+        size *= 2;
+
+    if (ng_pages_size >= ng_pages_capacity)
+    {
+        int capacity = ng_pages_capacity > 0 ? ng_pages_capacity * 2 : 8;
+        ng_page* pages = realloc(ng_pages, capacity * sizeof(ng_page));
+        if (pages == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+        if (ng_pages_capacity == 0)
+            memset(pages, 0, sizeof(ng_page));
+        ng_pages = pages;
+        ng_pages_capacity = capacity;
+    }
+
+    ng_page* page = &ng_pages[ng_pages_size];
+    memset(page, 0, sizeof(ng_page));
+    page->width = size;
+    page->height = size;
+    page->pixels = malloc((size_t)size * size * 4);
+    if (page->pixels == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    ng_page_clear(page);
+    return ng_pages_size++;
+}
+
+// transparent apart from the white corner; the texture keeps what it
+// has, as nothing samples the freed places until images are put there
+void ng_page_clear(ng_page* page)
+{
+    int white_x, white_y;
+    int y;
+
+    ng_page_white(page, &white_x, &white_y);
+    memset(page->pixels, 0, (size_t)page->width * page->height * 4);
+    for (y = white_y; y < page->height; ++y)
+    {
+        memset(page->pixels + ((size_t)y * page->width + white_x) * 4, 0xFF,
+               (size_t)(page->width - white_x) * 4);
+    }
+    page->shelves_size = 0;
+    page->top = 0;
+    page->dirty_y0 = page->dirty_y1 = 0;
+}
+
+// the corner solid quads sample, the top right of the page
+void ng_page_white(const ng_page* page, int* x, int* y)
+{
+    *x = page->width - page->width * NG_FONT_WHITE_SIZE / NG_FONT_ATLAS_WIDTH;
+    *y = page->height - page->height * NG_FONT_WHITE_SIZE /
+                        NG_FONT_ATLAS_HEIGHT;
+}
+
+void ng_upload_white(const ng_page* page)
+{
+    int white_x, white_y;
+    ng_page_white(page, &white_x, &white_y);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, page->width);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, white_x, white_y, page->width - white_x,
+                    page->height - white_y, GL_RGBA, GL_UNSIGNED_BYTE,
+                    page->pixels + ((size_t)white_y * page->width + white_x) * 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+// with a pixel buffer object where there are any: the rows are written
+// once into the mapped buffer, whose old contents are given up so the
+// mapping doesn't wait for the last upload, and GL fills the bound
+// texture from it while the caller goes on. Without a mapping the rows
+// go straight from the page.
+void ng_upload_rows(ng_page* page)
+{
+    const GLubyte* rows = page->pixels +
+                          (size_t)page->dirty_y0 * page->width * 4;
+    GLsizei height = page->dirty_y1 - page->dirty_y0;
+    GLsizeiptr bytes = (GLsizeiptr)height * page->width * 4;
+    int pbo = ng_backend == NG_BACKEND_GL33 || GLEW_VERSION_2_1 ||
+              GLEW_ARB_pixel_buffer_object;
+    if (pbo)
+    {
+        GLvoid* mapped;
+        if (ng_upload_buffer == 0)
+            glGenBuffers(1, &ng_upload_buffer);
+        ng_gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, ng_upload_buffer);
+        if (ng_backend == NG_BACKEND_GL33 || GLEW_VERSION_3_0 ||
+            GLEW_ARB_map_buffer_range)
+        {
+            if (bytes > ng_upload_buffer_size)
+            {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL,
+                             GL_STREAM_DRAW);
+                ng_upload_buffer_size = bytes;
+            }
+            mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                      GL_MAP_WRITE_BIT |
+                                      GL_MAP_INVALIDATE_BUFFER_BIT);
+        }
+        else
+        {
+            // orphaning does what invalidating does
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            ng_upload_buffer_size = bytes;
+            mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        }
+        if (mapped != NULL)
+        {
+            memcpy(mapped, rows, bytes);
+            if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+                rows = NULL;
+        }
+        if (rows != NULL)
+        {
+            ng_gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            pbo = 0;
+        }
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, page->dirty_y0, page->width, height,
+                    GL_RGBA, GL_UNSIGNED_BYTE, rows);
+    if (pbo)
+        ng_gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// in the order of ng_draw_rectangle, in the current color without one;
+// page_size is the width and height of the image's page
+void ng_sprite_quad(const ng_image* image, const int* page_size,
+                    int x0, int y0, int x1, int y1, const GLubyte* color)
+{
+    ng_vertex* v = ng_batch_reserve(NG_QUADS, 4, 1.0f, image->page);
+    if (v == NULL)
+        return;
+
+    GLfloat u0 = (GLfloat)image->x / page_size[0];
+    GLfloat v0 = (GLfloat)image->y / page_size[1];
+    GLfloat u1 = (GLfloat)(image->x + image->width) / page_size[0];
+    GLfloat v1 = (GLfloat)(image->y + image->height) / page_size[1];
+
+    ng_put_vertex(v,   (GLfloat)x0, (GLfloat)y0);
+    ng_put_vertex(v+1, (GLfloat)x0, (GLfloat)y1);
+    ng_put_vertex(v+2, (GLfloat)x1, (GLfloat)y1);
+    ng_put_vertex(v+3, (GLfloat)x1, (GLfloat)y0);
+    v[0].u = v[1].u = u0;
+    v[2].u = v[3].u = u1;
+    v[0].v = v[3].v = v0;
+    v[1].v = v[2].v = v1;
+    if (color != NULL)
+    {
+        int i;
+        for (i = 0; i < 4; ++i)
+            memcpy(v[i].color, color, 4);
+    }
+}
+
+int ng_sprite_page(const ng_sprite* sprite, int pages)
+{
+    const ng_image* image = sprite->image;
+    return image != NULL && image->state == NG_IMAGE_READY &&
+           image->page < pages ? image->page : -1;
+}
@@ -0,0 +1,220 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/* Every worker owns a range of task indices packed as begin << 32 | end.
+   The owner takes tasks from the front and idle workers steal from the
+   back; both sides move the range with one compare-and-swap. */
+typedef struct
+{
+    _Atomic unsigned long long range;
+    char padding[64 - sizeof(unsigned long long)];
+} ng_pool_queue;
+
+static void* ng_pool_main(void* arg);
+static void ng_pool_work(int self);
+static int ng_pool_pop(ng_pool_queue* q, int* task);
+static int ng_pool_steal(ng_pool_queue* q, int* task);
+
+static pthread_t* ng_pool_threads;
+static ng_pool_queue* ng_pool_queues;
+static int ng_pool_size = 1;
+static pthread_mutex_t ng_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+// held by the thread the pool works for
+static pthread_mutex_t ng_pool_run_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ng_pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t ng_pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned int ng_pool_generation;
+static int ng_pool_active;
+static int ng_pool_stop;
+static ng_task_func ng_pool_func;
+static void* ng_pool_ctx;
+// set on the workers and while the pool's owner works on its tasks
+static _Thread_local int ng_pool_inside;
+
+int ng_pool_init(int threads)
+{
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 1)
+        return 1;
+
+    ng_pool_queues = aligned_alloc(64, sizeof(ng_pool_queue) * threads);
+    ng_pool_threads = malloc(sizeof(pthread_t) * threads);
+    if (ng_pool_queues == NULL || ng_pool_threads == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        ng_pool_free();
+        return 0;
+    }
+
+    int i;
+    for (i = 0; i < threads; ++i)
+        atomic_init(&ng_pool_queues[i].range, 0);
+
+    ng_pool_stop = 0;
+    ng_pool_size = 1;
+    for (i = 1; i < threads; ++i)
+    {
+        if (pthread_create(&ng_pool_threads[i], NULL, ng_pool_main,
+                           (void*)(size_t)i) != 0)
+        {
+            fprintf(stderr, "pthread_create failed, using %d threads\n", i);
+            break;
+        }
+        ++ng_pool_size;
+    }
+
+    return 1;
+}
+
+void ng_pool_free()
+{
+    int i;
+    if (ng_pool_threads != NULL)
+    {
+        pthread_mutex_lock(&ng_pool_mutex);
+        ng_pool_stop = 1;
+        pthread_cond_broadcast(&ng_pool_wake);
+        pthread_mutex_unlock(&ng_pool_mutex);
+        for (i = 1; i < ng_pool_size; ++i)
+            pthread_join(ng_pool_threads[i], NULL);
+    }
+
+    free(ng_pool_threads);
+    free(ng_pool_queues);
+    ng_pool_threads = NULL;
+    ng_pool_queues = NULL;
+    ng_pool_size = 1;
+}
+
+int ng_pool_threads_count()
+{
+    return ng_pool_size;
+}
+
+// runs func(task, ctx) for every task in [0, tasks) and returns when all
+// of them are done; the calling thread works too. Callers on other
+// threads wait their turn for the pool, a task that runs tasks of its
+// own does them itself, as the pool is waiting for it
+void ng_pool_run(int tasks, ng_task_func func, void* ctx)
+{
+    int i;
+    if (ng_pool_size <= 1 || tasks <= 1 || ng_pool_inside)
+    {
+        for (i = 0; i < tasks; ++i)
+            func(i, ctx);
+        return;
+    }
+    pthread_mutex_lock(&ng_pool_run_mutex);
+
+    for (i = 0; i < ng_pool_size; ++i)
+    {
+        unsigned long long begin = (unsigned long long)tasks * i / ng_pool_size;
+        unsigned long long end = (unsigned long long)tasks * (i + 1) / ng_pool_size;
+        atomic_store(&ng_pool_queues[i].range, begin << 32 | end);
+    }
+
+    pthread_mutex_lock(&ng_pool_mutex);
+    ng_pool_func = func;
+    ng_pool_ctx = ctx;
+    ng_pool_active = ng_pool_size - 1;
+    ++ng_pool_generation;
+    pthread_cond_broadcast(&ng_pool_wake);
+    pthread_mutex_unlock(&ng_pool_mutex);
+
+    ng_pool_inside = 1;
+    ng_pool_work(0);
+    ng_pool_inside = 0;
+
+    pthread_mutex_lock(&ng_pool_mutex);
+    while (ng_pool_active > 0)
+        pthread_cond_wait(&ng_pool_done, &ng_pool_mutex);
+    pthread_mutex_unlock(&ng_pool_mutex);
+    pthread_mutex_unlock(&ng_pool_run_mutex);
+}
+
+void* ng_pool_main(void* arg)
+{
+    int self = (int)(size_t)arg;
+    unsigned int generation = 0;
+
+    ng_pool_inside = 1;
+    pthread_mutex_lock(&ng_pool_mutex);
+    for (;;)
+    {
+        while (!ng_pool_stop && generation == ng_pool_generation)
+            pthread_cond_wait(&ng_pool_wake, &ng_pool_mutex);
+        if (ng_pool_stop)
+            break;
+        generation = ng_pool_generation;
+        pthread_mutex_unlock(&ng_pool_mutex);
+
+        ng_pool_work(self);
+
+        pthread_mutex_lock(&ng_pool_mutex);
+        if (--ng_pool_active == 0)
+            pthread_cond_signal(&ng_pool_done);
+    }
+    pthread_mutex_unlock(&ng_pool_mutex);
+    return NULL;
+}
+
+void ng_pool_work(int self)
+{
+    int task, i;
+    for (;;)
+    {
+        while (ng_pool_pop(&ng_pool_queues[self], &task))
+            ng_pool_func(task, ng_pool_ctx);
+
+        int stolen = 0;
+        for (i = 1; i < ng_pool_size && !stolen; ++i)
+        {
+            int victim = (self + i) % ng_pool_size;
+            stolen = ng_pool_steal(&ng_pool_queues[victim], &task);
+        }
+        if (!stolen)
+            return;
+        ng_pool_func(task, ng_pool_ctx);
+    }
+}
+
+int ng_pool_pop(ng_pool_queue* q, int* task)
+{
+    unsigned long long range = atomic_load(&q->range);
+    for (;;)
+    {
+        unsigned long long begin = range >> 32;
+        unsigned long long end = range & 0xFFFFFFFFull;
+        if (begin >= end)
+            return 0;
+        if (atomic_compare_exchange_weak(&q->range, &range,
+                                         (begin + 1) << 32 | end))
+        {
+            *task = (int)begin;
+            return 1;
+        }
+    }
+}
+
+int ng_pool_steal(ng_pool_queue* q, int* task)
+{
+    unsigned long long range = atomic_load(&q->range);
+    for (;;)
+    {
+        unsigned long long begin = range >> 32;
+        unsigned long long end = range & 0xFFFFFFFFull;
+        if (begin >= end)
+            return 0;
+        if (atomic_compare_exchange_weak(&q->range, &range,
+                                         begin << 32 | (end - 1)))
+        {
+            *task = (int)(end - 1);
+            return 1;
+        }
+    }
+}
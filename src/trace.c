@@ -0,0 +1,602 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+/* a trace is "NGTR", a version byte and a stream of operations: the
+   NG_TRACE_* byte and its numbers as zigzag varints, so coordinates and
+   small counts take a byte or two. Arrays are their count and the
+   fields of every item, text is its length and bytes, and the first
+   recorded call using an image is preceded by its id, size and raw
+   pixels, rows from the top. */
+#define NG_TRACE_VERSION 3
+#define NG_TRACE_BUFFER_SIZE 65536
+
+typedef struct
+{
+    int geometry;
+    int recorded;
+    int replayed;
+} ng_replay_mark;
+
+static void ng_trace_reserve(int bytes);
+static void ng_trace_put(int value);
+static void ng_trace_bytes(const void* bytes, size_t size);
+static void ng_trace_flush();
+static void ng_trace_fail();
+static void ng_replay_update(int dt);
+static void ng_replay_render();
+static int ng_replay_op(int op);
+static int ng_replay_ints(int* values, int count);
+static int* ng_replay_array(int* count, int fields);
+static void* ng_replay_reserve(size_t bytes);
+static int ng_replay_mark_find(int geometry, int recorded);
+static int ng_replay_set(void*** table, int* capacity, int id, void* item);
+static void* ng_replay_get(void** table, int capacity, int id);
+
+/* only the thread that opened the trace records, worker threads
+   recording command lists leave it alone */
+_Thread_local int ng_trace_recording;
+int ng_trace_replaying;
+int ng_trace_session;
+
+static FILE* ng_trace_file;
+static unsigned char* ng_trace_buffer;
+static int ng_trace_size;
+static _Thread_local int ng_trace_paused;
+static _Thread_local int ng_trace_owner;
+static int ng_trace_images;
+static int ng_trace_geometries;
+
+static const unsigned char* ng_replay_data;
+static size_t ng_replay_size;
+static size_t ng_replay_pos;
+static void* ng_replay_scratch;
+static size_t ng_replay_scratch_size;
+static void** ng_replay_images;
+static int ng_replay_images_capacity;
+static void** ng_replay_geometries;
+static int ng_replay_geometries_capacity;
+static int ng_replay_geometry;
+static ng_replay_mark* ng_replay_marks;
+static int ng_replay_marks_size;
+static int ng_replay_marks_capacity;
+
+int ng_record_trace(const char* path)
+{
+    if (ng_trace_buffer != NULL)
+    {
+        fprintf(stderr, "ng_record_trace: already recording\n");
+        return 0;
+    }
+
+    ng_trace_buffer = malloc(NG_TRACE_BUFFER_SIZE);
+    if (ng_trace_buffer == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    ng_trace_file = fopen(path, "wb");
+    if (ng_trace_file == NULL)
+    {
+        fprintf(stderr, "can't create %s\n", path);
+        free(ng_trace_buffer);
+        ng_trace_buffer = NULL;
+        return 0;
+    }
+
+    memcpy(ng_trace_buffer, "NGTR", 4);
+    ng_trace_buffer[4] = NG_TRACE_VERSION;
+    ng_trace_size = 5;
+    ng_trace_owner = 1;
+    ng_trace_recording = ng_trace_paused == 0;
+    return 1;
+}
+
+void ng_trace_ints(int op, int count, ...)
+{
+    va_list args;
+    int i;
+    ng_trace_reserve(1 + count * 5);
+    ng_trace_buffer[ng_trace_size++] = (unsigned char)op;
+    va_start(args, count);
+    for (i = 0; i < count; ++i)
+        ng_trace_put(va_arg(args, int));
+    va_end(args);
+}
+
+// the items are structs of int sized fields
+void ng_trace_array(int op, int arg, const void* items, int count, int fields)
+{
+    const int* values = items;
+    int i;
+    if (count < 0)
+        count = 0;
+    ng_trace_ints(op, 2, arg, count);
+    for (i = 0; i < count * fields; ++i)
+    {
+        ng_trace_reserve(5);
+        ng_trace_put(values[i]);
+    }
+}
+
+void ng_trace_text(int x, int y, const char* text)
+{
+    int length = (int)strlen(text);
+    ng_trace_ints(NG_TRACE_TEXT, 3, x, y, length);
+    ng_trace_bytes(text, length);
+}
+
+// numbers the image and stores its pixels the first time it is used;
+// the id is only written by the thread drawing, so it is kept in the
+// image even though the draw calls take it const
+int ng_trace_image(const ng_image* image)
+{
+    if (image == NULL || image->state != NG_IMAGE_READY)
+        return 0;
+    if (ng_trace_id(image->trace_id, image->trace_session) != 0)
+        return image->trace_id;
+
+    int id = ++ng_trace_images;
+    ((ng_image*)image)->trace_id = id;
+    ((ng_image*)image)->trace_session = ng_trace_session;
+    int width, height, row;
+    const GLubyte* pixels = ng_page_pixels(image->page, &width, &height);
+    ng_trace_ints(NG_TRACE_IMAGE, 3, id, image->width, image->height);
+    for (row = image->height - 1; row >= 0; --row)
+    {
+        ng_trace_bytes(pixels + ((size_t)(image->y + row) * width +
+                                 image->x) * 4,
+                       (size_t)image->width * 4);
+    }
+    return id;
+}
+
+// the images go first, so their pixels aren't in the middle of the array
+void ng_trace_sprites(const ng_sprite* sprites, int count)
+{
+    int i;
+    for (i = 0; i < count; ++i)
+        ng_trace_image(sprites[i].image);
+
+    ng_trace_ints(NG_TRACE_SPRITES, 1, count);
+    for (i = 0; i < count; ++i)
+    {
+        const ng_sprite* s = &sprites[i];
+        ng_trace_reserve(6 * 5);
+        ng_trace_put(ng_trace_image(s->image));
+        ng_trace_put(s->x0);
+        ng_trace_put(s->y0);
+        ng_trace_put(s->x1);
+        ng_trace_put(s->y1);
+        ng_trace_put((int)s->color);
+    }
+}
+
+int ng_trace_new_geometry()
+{
+    return ++ng_trace_geometries;
+}
+
+int ng_trace_id(int id, int session)
+{
+    return session == ng_trace_session ? id : 0;
+}
+
+void ng_trace_pause()
+{
+    ++ng_trace_paused;
+    if (ng_trace_recording)
+        ng_trace_recording = 0;
+}
+
+void ng_trace_resume()
+{
+    if (--ng_trace_paused == 0 && ng_trace_owner && ng_trace_file != NULL)
+        ng_trace_recording = 1;
+}
+
+void ng_trace_close()
+{
+    if (ng_trace_buffer == NULL)
+        return;
+
+    ng_trace_flush();
+    if (ng_trace_file != NULL && fclose(ng_trace_file) != 0)
+        fprintf(stderr, "can't write the trace\n");
+    ng_trace_file = NULL;
+    ng_trace_recording = 0;
+    ng_trace_owner = 0;
+    free(ng_trace_buffer);
+    ng_trace_buffer = NULL;
+
+    // the next recording numbers everything again
+    ng_trace_images = 0;
+    ng_trace_geometries = 0;
+    ++ng_trace_session;
+}
+
+void ng_trace_reserve(int bytes)
+{
+    if (ng_trace_size + bytes > NG_TRACE_BUFFER_SIZE)
+        ng_trace_flush();
+}
+
+void ng_trace_put(int value)
+{
+    unsigned int v = (unsigned int)value << 1 ^ (unsigned int)(value >> 31);
+    while (v >= 0x80)
+    {
+        ng_trace_buffer[ng_trace_size++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    ng_trace_buffer[ng_trace_size++] = (unsigned char)v;
+}
+
+// bytes that don't fit in the buffer go straight to the file
+void ng_trace_bytes(const void* bytes, size_t size)
+{
+    if (ng_trace_size + size > NG_TRACE_BUFFER_SIZE)
+    {
+        ng_trace_flush();
+        if (size > NG_TRACE_BUFFER_SIZE)
+        {
+            if (ng_trace_file != NULL &&
+                fwrite(bytes, 1, size, ng_trace_file) != size)
+                ng_trace_fail();
+            return;
+        }
+    }
+    memcpy(ng_trace_buffer + ng_trace_size, bytes, size);
+    ng_trace_size += (int)size;
+}
+
+void ng_trace_flush()
+{
+    if (ng_trace_file != NULL && ng_trace_size > 0 &&
+        fwrite(ng_trace_buffer, 1, ng_trace_size, ng_trace_file) !=
+            (size_t)ng_trace_size)
+        ng_trace_fail();
+    ng_trace_size = 0;
+}
+
+// a write error ends the recording; the buffer stays until
+// ng_trace_close for the call that is still writing into it
+void ng_trace_fail()
+{
+    fprintf(stderr, "can't write the trace\n");
+    fclose(ng_trace_file);
+    ng_trace_file = NULL;
+    ng_trace_recording = 0;
+}
+
+// runs ng_init_graphics with the recorded window size; every frame
+// issues the calls of one recorded frame, without waiting between them
+int ng_replay_trace(const char* path)
+{
+    size_t size;
+    unsigned char* data = ng_read_file(path, &size);
+    if (data == NULL)
+        return 0;
+
+    int window[2];
+    ng_replay_data = data;
+    ng_replay_size = size;
+    ng_replay_pos = 5;
+    if (size < 6 || memcmp(data, "NGTR", 4) != 0 ||
+        data[4] != NG_TRACE_VERSION || data[5] != NG_TRACE_WINDOW)
+    {
+        fprintf(stderr, "ng_replay_trace: %s isn't a trace\n", path);
+        free(data);
+        return 0;
+    }
+    ++ng_replay_pos;
+    if (!ng_replay_ints(window, 2))
+    {
+        fprintf(stderr, "ng_replay_trace: %s is cut short\n", path);
+        free(data);
+        return 0;
+    }
+
+    ng_trace_replaying = 1;
+    ng_init_graphics(window[0], window[1], "replay", ng_replay_update,
+                     ng_replay_render);
+    ng_trace_replaying = 0;
+
+    free(data);
+    free(ng_replay_scratch);
+    free(ng_replay_images);
+    free(ng_replay_geometries);
+    free(ng_replay_marks);
+    ng_replay_data = NULL;
+    ng_replay_scratch = NULL;
+    ng_replay_scratch_size = 0;
+    ng_replay_images = NULL;
+    ng_replay_images_capacity = 0;
+    ng_replay_geometries = NULL;
+    ng_replay_geometries_capacity = 0;
+    ng_replay_marks = NULL;
+    ng_replay_marks_size = 0;
+    ng_replay_marks_capacity = 0;
+    return 1;
+}
+
+// the recorded frames already show what the updates did, so there is
+// nothing to update; the end of the trace quits before another frame
+// starts
+void ng_replay_update(int dt)
+{
+    (void)dt;
+    if (ng_replay_pos >= ng_replay_size)
+        ng_quit();
+}
+
+void ng_replay_render()
+{
+    while (ng_replay_pos < ng_replay_size)
+    {
+        size_t pos = ng_replay_pos;
+        int op = ng_replay_data[ng_replay_pos++];
+        if (op == NG_TRACE_FRAME)
+            return;
+        if (!ng_replay_op(op))
+        {
+            fprintf(stderr, "ng_replay_trace: bad operation %d at %zu\n",
+                    op, pos);
+            ng_replay_pos = ng_replay_size;
+        }
+    }
+}
+
+int ng_replay_op(int op)
+{
+    int a[6];
+    int count;
+    int* items;
+
+    switch (op)
+    {
+    case NG_TRACE_COLOR:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_set_color((unsigned int)a[0]);
+        return 1;
+    case NG_TRACE_LINE:
+        if (!ng_replay_ints(a, 5))
+            return 0;
+        ng_draw_line(a[0], a[1], a[2], a[3], a[4]);
+        return 1;
+    case NG_TRACE_POLYLINE:
+    case NG_TRACE_POINTS:
+        if (!ng_replay_ints(a, 1) || (items = ng_replay_array(&count, 2)) == NULL)
+            return 0;
+        if (op == NG_TRACE_POLYLINE)
+            ng_draw_polyline((const ng_point*)items, count, a[0]);
+        else
+            ng_draw_points((const ng_point*)items, count, a[0]);
+        return 1;
+    case NG_TRACE_DECIMATION:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_set_decimation(a[0]);
+        return 1;
+    case NG_TRACE_LINE_CAP:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_set_line_cap(a[0]);
+        return 1;
+    case NG_TRACE_RECTANGLE:
+        if (!ng_replay_ints(a, 4))
+            return 0;
+        ng_draw_rectangle(a[0], a[1], a[2], a[3]);
+        return 1;
+    case NG_TRACE_TEXT:
+    {
+        char* text;
+        if (!ng_replay_ints(a, 3) || a[2] < 0 ||
+            (size_t)a[2] > ng_replay_size - ng_replay_pos ||
+            (text = ng_replay_reserve((size_t)a[2] + 1)) == NULL)
+            return 0;
+        memcpy(text, ng_replay_data + ng_replay_pos, a[2]);
+        text[a[2]] = '\0';
+        ng_replay_pos += a[2];
+        ng_draw_text(a[0], a[1], text);
+        return 1;
+    }
+    case NG_TRACE_RECTANGLES:
+    case NG_TRACE_LINES:
+        if (!ng_replay_ints(a, 1) || (items = ng_replay_array(&count, 5)) == NULL)
+            return 0;
+        if (op == NG_TRACE_RECTANGLES)
+            ng_draw_rectangles((const ng_rect*)items, count);
+        else
+            ng_draw_lines((const ng_line*)items, count, a[0]);
+        return 1;
+    case NG_TRACE_IMAGE:
+    {
+        if (!ng_replay_ints(a, 3) || a[1] <= 0 || a[2] <= 0 ||
+            (size_t)a[1] * a[2] * 4 > ng_replay_size - ng_replay_pos)
+            return 0;
+        ng_image* image = ng_create_image(ng_replay_data + ng_replay_pos,
+                                          a[1], a[2]);
+        ng_replay_pos += (size_t)a[1] * a[2] * 4;
+        return ng_replay_set(&ng_replay_images, &ng_replay_images_capacity,
+                             a[0], image);
+    }
+    case NG_TRACE_DRAW_IMAGE:
+        if (!ng_replay_ints(a, 5))
+            return 0;
+        ng_draw_image_scaled(ng_replay_get(ng_replay_images,
+                                           ng_replay_images_capacity, a[0]),
+                             a[1], a[2], a[3], a[4]);
+        return 1;
+    case NG_TRACE_SPRITES:
+    {
+        int i;
+        if (ng_replay_array(&count, 6) == NULL ||
+            ng_replay_reserve((size_t)count * sizeof(ng_sprite)) == NULL)
+            return 0;
+        // a sprite takes more room than its fields, so they are made in
+        // place from the last one down
+        items = ng_replay_scratch;
+        ng_sprite* sprites = ng_replay_scratch;
+        for (i = count - 1; i >= 0; --i)
+        {
+            const int* f = items + i * 6;
+            ng_sprite s = {
+                ng_replay_get(ng_replay_images, ng_replay_images_capacity,
+                              f[0]),
+                f[1], f[2], f[3], f[4], (unsigned int)f[5]
+            };
+            sprites[i] = s;
+        }
+        ng_draw_sprites(sprites, count);
+        return 1;
+    }
+    case NG_TRACE_FREE_IMAGE:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_free_image(ng_replay_get(ng_replay_images,
+                                    ng_replay_images_capacity, a[0]));
+        ng_replay_set(&ng_replay_images, &ng_replay_images_capacity, a[0],
+                      NULL);
+        return 1;
+    case NG_TRACE_BEGIN_GEOMETRY:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_replay_geometry = a[0];
+        return ng_replay_set(&ng_replay_geometries,
+                             &ng_replay_geometries_capacity, a[0],
+                             ng_begin_geometry());
+    case NG_TRACE_GEOMETRY_MARK:
+    {
+        ng_replay_mark* marks;
+        if (!ng_replay_ints(a, 1) ||
+            (marks = ng_grow(ng_replay_marks, &ng_replay_marks_capacity,
+                             ng_replay_marks_size + 1,
+                             sizeof(ng_replay_mark))) == NULL)
+            return 0;
+        ng_replay_marks = marks;
+        ng_replay_mark m = { ng_replay_geometry, a[0], ng_geometry_mark() };
+        ng_replay_marks[ng_replay_marks_size++] = m;
+        return 1;
+    }
+    case NG_TRACE_UPDATE_GEOMETRY:
+        if (!ng_replay_ints(a, 2))
+            return 0;
+        ng_replay_geometry = a[0];
+        ng_begin_geometry_update(ng_replay_get(ng_replay_geometries,
+                                               ng_replay_geometries_capacity,
+                                               a[0]),
+                                 ng_replay_mark_find(a[0], a[1]));
+        return 1;
+    case NG_TRACE_END_GEOMETRY:
+        ng_end_geometry();
+        return 1;
+    case NG_TRACE_DRAW_GEOMETRY:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_draw_geometry(ng_replay_get(ng_replay_geometries,
+                                       ng_replay_geometries_capacity, a[0]));
+        return 1;
+    case NG_TRACE_FREE_GEOMETRY:
+        if (!ng_replay_ints(a, 1))
+            return 0;
+        ng_free_geometry(ng_replay_get(ng_replay_geometries,
+                                       ng_replay_geometries_capacity, a[0]));
+        ng_replay_set(&ng_replay_geometries, &ng_replay_geometries_capacity,
+                      a[0], NULL);
+        return 1;
+    }
+    return 0;
+}
+
+int ng_replay_ints(int* values, int count)
+{
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        unsigned int v = 0;
+        int shift = 0;
+        unsigned char b;
+        do
+        {
+            if (ng_replay_pos >= ng_replay_size || shift > 28)
+                return 0;
+            b = ng_replay_data[ng_replay_pos++];
+            v |= (unsigned int)(b & 0x7F) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        values[i] = (int)(v >> 1) ^ -(int)(v & 1);
+    }
+    return 1;
+}
+
+// reads the count and count items of fields ints into the scratch
+// buffer; every field takes at least a byte of the trace
+int* ng_replay_array(int* count, int fields)
+{
+    int* items;
+    if (!ng_replay_ints(count, 1) || *count < 0 ||
+        (size_t)*count * fields > ng_replay_size - ng_replay_pos ||
+        (items = ng_replay_reserve((size_t)*count * fields * sizeof(int) + 1))
+            == NULL)
+        return NULL;
+    return ng_replay_ints(items, *count * fields) ? items : NULL;
+}
+
+// grows the scratch buffer keeping what it holds
+void* ng_replay_reserve(size_t bytes)
+{
+    if (bytes > ng_replay_scratch_size)
+    {
+        void* scratch = realloc(ng_replay_scratch, bytes);
+        if (scratch == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return NULL;
+        }
+        ng_replay_scratch = scratch;
+        ng_replay_scratch_size = bytes;
+    }
+    return ng_replay_scratch;
+}
+
+// the latest mark of the geometry recorded with that value
+int ng_replay_mark_find(int geometry, int recorded)
+{
+    int i;
+    for (i = ng_replay_marks_size - 1; i >= 0; --i)
+    {
+        const ng_replay_mark* m = &ng_replay_marks[i];
+        if (m->geometry == geometry && m->recorded == recorded)
+            return m->replayed;
+    }
+    return -1;
+}
+
+int ng_replay_set(void*** table, int* capacity, int id, void* item)
+{
+    if (id <= 0)
+        return 0;
+    if (id >= *capacity)
+    {
+        int grown = *capacity > 0 ? *capacity : 64;
+        while (grown <= id)
+            grown *= 2;
+        void** items = realloc(*table, grown * sizeof(void*));
+        if (items == NULL)
+            return 0;
+        memset(items + *capacity, 0, (grown - *capacity) * sizeof(void*));
+        *table = items;
+        *capacity = grown;
+    }
+    (*table)[id] = item;
+    return 1;
+}
+
+void* ng_replay_get(void** table, int capacity, int id)
+{
+    return id > 0 && id < capacity ? table[id] : NULL;
+}
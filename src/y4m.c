@@ -0,0 +1,328 @@
+#include "internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NG_I420_X86 1
+#include <immintrin.h>
+#endif
+
+/* YUV4MPEG2 for an encoder reading a pipe: BT.601 limited range 4:2:0,
+   chroma from the average of each 2x2 block. A frame is converted into
+   one buffer holding the three planes, which is written straight after
+   its FRAME line, so the stream costs no copy beyond the conversion. */
+
+static void ng_i420_rows_scalar(const unsigned char* row0,
+                                const unsigned char* row1, int width,
+                                unsigned char* y0, unsigned char* y1,
+                                unsigned char* u, unsigned char* v);
+#ifdef NG_I420_X86
+static void ng_i420_rows_sse2(const unsigned char* row0,
+                              const unsigned char* row1, int width,
+                              unsigned char* y0, unsigned char* y1,
+                              unsigned char* u, unsigned char* v);
+#endif
+static void ng_y4m_init_kernels();
+static void ng_y4m_convert(const unsigned char* rgba, int bottom_up);
+static int ng_y4m_put(int fd, const char* text, size_t length,
+                      const unsigned char* data, size_t size);
+
+static const ng_i420_kernels ng_all_i420_kernels[] = {
+    { "scalar", ng_i420_rows_scalar },
+#ifdef NG_I420_X86
+    { "sse2", ng_i420_rows_sse2 },
+#endif
+};
+
+/* the stream belongs to the capture thread */
+static int ng_i420_kernels_supported;
+static ng_i420_func ng_i420_rows;
+static int ng_y4m_generation;       // the stream being written, 0 for none
+static int ng_y4m_width;
+static int ng_y4m_height;
+static unsigned char* ng_y4m_planes;
+static size_t ng_y4m_size;
+static int ng_y4m_frames;           // frames sent to this stream
+static int ng_y4m_warned;
+
+int ng_y4m_open(const char* path)
+{
+    // a named pipe only opens once the encoder has opened it too
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        fprintf(stderr, "can't open %s: %s\n", path, strerror(errno));
+    return fd;
+}
+
+// the header goes out with the first frame of a generation, which fixes
+// the size; frames of another size are left out. repeats sends the last
+// frame again first, for frames that were dropped. Returns 0 once the
+// stream fails
+int ng_y4m_write(int fd, int generation, const unsigned char* rgba,
+                 int width, int height, int bottom_up, int repeats)
+{
+    char header[128];
+    int length = 0;
+    if (ng_i420_rows == NULL)
+        ng_y4m_init_kernels();
+
+    if (generation != ng_y4m_generation)
+    {
+        size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+        unsigned char* planes = realloc(ng_y4m_planes,
+                                        (size_t)width * height + chroma * 2);
+        if (planes == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        }
+        ng_y4m_planes = planes;
+        ng_y4m_size = (size_t)width * height + chroma * 2;
+        ng_y4m_width = width;
+        ng_y4m_height = height;
+        ng_y4m_frames = 0;
+        ng_y4m_warned = 0;
+        ng_y4m_generation = generation;
+        length = snprintf(header, sizeof(header),
+                          "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg "
+                          "XCOLORRANGE=LIMITED\n",
+                          width, height, ng_get_update_rate());
+    }
+    else if (width != ng_y4m_width || height != ng_y4m_height)
+    {
+        if (!ng_y4m_warned)
+            fprintf(stderr, "the Y4M stream stays %dx%d, frames of %dx%d "
+                    "are left out\n", ng_y4m_width, ng_y4m_height, width,
+                    height);
+        ng_y4m_warned = 1;
+        return 1;
+    }
+
+    for (; repeats > 0 && ng_y4m_frames > 0; --repeats)
+    {
+        if (!ng_y4m_put(fd, "FRAME\n", 6, ng_y4m_planes, ng_y4m_size))
+            return 0;
+    }
+
+    ng_y4m_convert(rgba, bottom_up);
+    if ((length > 0 && !ng_y4m_put(fd, header, length, NULL, 0)) ||
+        !ng_y4m_put(fd, "FRAME\n", 6, ng_y4m_planes, ng_y4m_size))
+        return 0;
+    ++ng_y4m_frames;
+    return 1;
+}
+
+// on the capture thread when it stops; the descriptor stays open
+void ng_y4m_free()
+{
+    free(ng_y4m_planes);
+    ng_y4m_planes = NULL;
+    ng_y4m_size = 0;
+    ng_y4m_generation = 0;
+}
+
+const ng_i420_kernels* ng_get_i420_kernels(int* count)
+{
+    if (ng_i420_kernels_supported == 0)
+        ng_y4m_init_kernels();
+    *count = ng_i420_kernels_supported;
+    return ng_all_i420_kernels;
+}
+
+// the same choice as the span kernels, NG_SIMD=scalar turns SSE2 off
+void ng_y4m_init_kernels()
+{
+    int count = 1;
+#ifdef NG_I420_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        count = 2;
+#endif
+    ng_i420_kernels_supported = count;
+
+    const ng_i420_kernels* k = &ng_all_i420_kernels[count - 1];
+    const char* env = getenv("NG_SIMD");
+    if (env != NULL && strcmp(env, "scalar") == 0)
+        k = &ng_all_i420_kernels[0];
+    ng_i420_rows = k->rows;
+}
+
+// the rows from the top; an odd last row pairs with itself
+void ng_y4m_convert(const unsigned char* rgba, int bottom_up)
+{
+    int width = ng_y4m_width;
+    int height = ng_y4m_height;
+    int chroma_width = (width + 1) / 2;
+    size_t row = (size_t)width * 4;
+    unsigned char* y = ng_y4m_planes;
+    unsigned char* u = y + (size_t)width * height;
+    unsigned char* v = u + (size_t)chroma_width * ((height + 1) / 2);
+    int i;
+
+    for (i = 0; i < height; i += 2)
+    {
+        int next = i + 1 < height ? i + 1 : i;
+        const unsigned char* row0 =
+            rgba + row * (bottom_up ? height - 1 - i : i);
+        const unsigned char* row1 =
+            rgba + row * (bottom_up ? height - 1 - next : next);
+        ng_i420_rows(row0, row1, width, y + (size_t)width * i,
+                     y + (size_t)width * next, u, v);
+        u += chroma_width;
+        v += chroma_width;
+    }
+}
+
+// the text, then the data, however many writes it takes
+int ng_y4m_put(int fd, const char* text, size_t length,
+               const unsigned char* data, size_t size)
+{
+    struct iovec parts[2];
+    int first = 0;
+    parts[0].iov_base = (void*)text;
+    parts[0].iov_len = length;
+    parts[1].iov_base = (void*)data;
+    parts[1].iov_len = size;
+    while (first < 2)
+    {
+        ssize_t written = writev(fd, parts + first, 2 - first);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "can't write the Y4M stream: %s\n",
+                    strerror(errno));
+            return 0;
+        }
+        while (first < 2 && (size_t)written >= parts[first].iov_len)
+            written -= parts[first++].iov_len;
+        if (first < 2)
+        {
+            parts[first].iov_base = (char*)parts[first].iov_base + written;
+            parts[first].iov_len -= written;
+        }
+    }
+    return 1;
+}
+
+// Y = (66 R + 129 G + 25 B + 128) / 256 + 16 for every pixel, U and V
+// the same way from the rounded average of each 2x2 block, shifted
+// arithmetically like every kernel does
+void ng_i420_rows_scalar(const unsigned char* row0, const unsigned char* row1,
+                         int width, unsigned char* y0, unsigned char* y1,
+                         unsigned char* u, unsigned char* v)
+{
+    int x;
+    for (x = 0; x < width; ++x)
+    {
+        const unsigned char* p = row0 + x * 4;
+        const unsigned char* q = row1 + x * 4;
+        y0[x] = (unsigned char)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+        y1[x] = (unsigned char)(((66 * q[0] + 129 * q[1] + 25 * q[2] + 128) >> 8) + 16);
+    }
+    for (x = 0; x < width; x += 2)
+    {
+        int right = x + 1 < width ? 4 : 0;
+        const unsigned char* p = row0 + x * 4;
+        const unsigned char* q = row1 + x * 4;
+        int r = (p[0] + p[right] + q[0] + q[right] + 2) >> 2;
+        int g = (p[1] + p[right + 1] + q[1] + q[right + 1] + 2) >> 2;
+        int b = (p[2] + p[right + 2] + q[2] + q[right + 2] + 2) >> 2;
+        u[x / 2] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[x / 2] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+#ifdef NG_I420_X86
+
+// the sums of adjacent 32-bit pairs of a and b: a0+a1 a2+a3 b0+b1 b2+b3
+__attribute__((target("sse2")))
+static inline __m128i ng_i420_pairs_sse2(__m128i a, __m128i b)
+{
+    __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                                 _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                                _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+// luma of 4 pixels as 32-bit values
+__attribute__((target("sse2")))
+static inline __m128i ng_i420_luma_sse2(__m128i p, __m128i coefficients)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(p, zero), coefficients);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(p, zero), coefficients);
+    __m128i sum = ng_i420_pairs_sse2(lo, hi);
+    return _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8),
+                         _mm_set1_epi32(16));
+}
+
+// the rounded 2x2 averages of 4 pixels in two rows: two RGBA as 16-bit
+__attribute__((target("sse2")))
+static inline __m128i ng_i420_average_sse2(__m128i p, __m128i q)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(p, zero),
+                               _mm_unpacklo_epi8(q, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(p, zero),
+                               _mm_unpackhi_epi8(q, zero));
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+                                _mm_unpackhi_epi64(lo, hi));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+// 4 chroma values from the averages of 8 pixels as bytes in the low 32 bits
+__attribute__((target("sse2")))
+static inline __m128i ng_i420_chroma_sse2(__m128i a, __m128i b,
+                                          __m128i coefficients)
+{
+    __m128i sum = ng_i420_pairs_sse2(_mm_madd_epi16(a, coefficients),
+                                     _mm_madd_epi16(b, coefficients));
+    sum = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8),
+                        _mm_set1_epi32(128));
+    sum = _mm_packs_epi32(sum, sum);
+    return _mm_packus_epi16(sum, sum);
+}
+
+// 8 pixels of both rows per step, the rest like the scalar kernel
+__attribute__((target("sse2")))
+void ng_i420_rows_sse2(const unsigned char* row0, const unsigned char* row1,
+                       int width, unsigned char* y0, unsigned char* y1,
+                       unsigned char* u, unsigned char* v)
+{
+    __m128i cy = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    __m128i cu = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    __m128i cv = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    int x, chroma;
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(row0 + x * 4));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(row0 + x * 4 + 16));
+        __m128i q0 = _mm_loadu_si128((const __m128i*)(row1 + x * 4));
+        __m128i q1 = _mm_loadu_si128((const __m128i*)(row1 + x * 4 + 16));
+
+        __m128i luma = _mm_packs_epi32(ng_i420_luma_sse2(p0, cy),
+                                       ng_i420_luma_sse2(p1, cy));
+        _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(luma, luma));
+        luma = _mm_packs_epi32(ng_i420_luma_sse2(q0, cy),
+                               ng_i420_luma_sse2(q1, cy));
+        _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(luma, luma));
+
+        __m128i a = ng_i420_average_sse2(p0, q0);
+        __m128i b = ng_i420_average_sse2(p1, q1);
+        chroma = _mm_cvtsi128_si32(ng_i420_chroma_sse2(a, b, cu));
+        memcpy(u + x / 2, &chroma, 4);
+        chroma = _mm_cvtsi128_si32(ng_i420_chroma_sse2(a, b, cv));
+        memcpy(v + x / 2, &chroma, 4);
+    }
+    ng_i420_rows_scalar(row0 + x * 4, row1 + x * 4, width - x, y0 + x, y1 + x,
+                        u + x / 2, v + x / 2);
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define WIDTH 64
+#define HEIGHT 32
+#define MAX_FRAMES 2000
+
+typedef struct
+{
+    const char* name;
+    const unsigned char* data;
+    int size;
+    int width, height;
+    const unsigned char* rgba;  /* NULL when the file must fail */
+    ng_image* image;
+} sample;
+
+static void on_update(int dt);
+static void on_render();
+static int write_sample(const sample* s, char* path);
+static int check_samples(const char* backend);
+static int run(int backend, const char* name);
+
+static const unsigned char ppm8[] =
+    "P6\n# a comment\n3 2\n255\n"
+    "\x01\x02\x03\x10\x20\x30\xFF\x80\x00"
+    "\x00\x00\x00\x7F\x7F\x7F\x05\xFA\x09";
+static const unsigned char ppm8_rgba[] = {
+    1, 2, 3, 255, 16, 32, 48, 255, 255, 128, 0, 255,
+    0, 0, 0, 255, 127, 127, 127, 255, 5, 250, 9, 255
+};
+
+/* two bytes a channel, scaled down from maxval */
+static const unsigned char ppm16[] =
+    "P6 2 1 65535 "
+    "\x00\x00\xFF\xFF\x80\x80\x12\x34\x00\x01\xFF\xFE";
+static const unsigned char ppm16_rgba[] = {
+    0, 255, 128, 255, 18, 0, 255, 255
+};
+
+/* every operation once: RGBA, RGB, DIFF, LUMA, a run of two, INDEX */
+static const unsigned char qoi[] =
+    "qoif\x00\x00\x00\x04\x00\x00\x00\x02\x04\x00"
+    "\xFF\x0A\x14\x1E\xFF"
+    "\xFE\x28\x32\x3C"
+    "\x5B"
+    "\xA5\x6B"
+    "\xC1"
+    "\x09"
+    "\xFF\x00\x00\xFF\xFF"
+    "\x00\x00\x00\x00\x00\x00\x00\x01";
+static const unsigned char qoi_rgba[] = {
+    10, 20, 30, 255, 40, 50, 60, 255, 39, 50, 61, 255, 42, 55, 69, 255,
+    42, 55, 69, 255, 42, 55, 69, 255, 10, 20, 30, 255, 0, 0, 255, 255
+};
+
+/* the stream ends before the last pixel */
+static const unsigned char qoi_short[] =
+    "qoif\x00\x00\x00\x02\x00\x00\x00\x01\x04\x00"
+    "\xFF\x0A\x14\x1E\xFF"
+    "\x00\x00\x00\x00\x00\x00\x00\x01";
+
+static sample samples[] = {
+    { "ppm", ppm8, sizeof(ppm8) - 1, 3, 2, ppm8_rgba, NULL },
+    { "16-bit ppm", ppm16, sizeof(ppm16) - 1, 2, 1, ppm16_rgba, NULL },
+    { "qoi", qoi, sizeof(qoi) - 1, 4, 2, qoi_rgba, NULL },
+    { "short qoi", qoi_short, sizeof(qoi_short) - 1, 2, 1, NULL, NULL },
+};
+#define SAMPLES (int)(sizeof(samples) / sizeof(samples[0]))
+
+// quits once every load has finished or failed; headless frames don't
+// wait, so they are slowed down for the loader thread
+void on_update(int dt)
+{
+    int i;
+    (void)dt;
+    for (i = 0; i < SAMPLES; ++i)
+    {
+        if (ng_image_ready(samples[i].image) == 0)
+        {
+            usleep(1000);
+            return;
+        }
+    }
+    ng_quit();
+}
+
+// the images side by side with their top rows at the top of the frame
+void on_render()
+{
+    int i;
+    ng_set_color(0xFFFFFFFF);
+    for (i = 0; i < SAMPLES; ++i)
+        ng_draw_image(samples[i].image, i * 8,
+                      HEIGHT - samples[i].height);
+}
+
+int write_sample(const sample* s, char* path)
+{
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 0;
+    int written = write(fd, s->data, s->size) == s->size;
+    close(fd);
+    return written;
+}
+
+// the decoded pixels against the frame, top row first
+int check_samples(const char* backend)
+{
+    int width, height;
+    const unsigned char* frame = ng_get_framebuffer(&width, &height);
+    int failed = 0;
+    int i, x, y;
+
+    for (i = 0; i < SAMPLES; ++i)
+    {
+        const sample* s = &samples[i];
+        int ready = ng_image_ready(s->image);
+        int ok = ready == (s->rgba != NULL ? 1 : -1);
+        for (y = 0; ok && s->rgba != NULL && y < s->height; ++y)
+        {
+            for (x = 0; x < s->width; ++x)
+            {
+                ok &= frame != NULL &&
+                      memcmp(frame + ((size_t)y * width + i * 8 + x) * 4,
+                             s->rgba + (y * s->width + x) * 4, 3) == 0;
+            }
+        }
+        printf("images: %s %s %s\n", backend, s->name, ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+    fflush(stdout);
+    return failed;
+}
+
+// a process of its own for every backend, as ng_init_graphics runs once
+int run(int backend, const char* name)
+{
+    int status;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        char paths[SAMPLES][32];
+        int i;
+        ng_set_backend(backend);
+        ng_set_headless(1);
+        ng_set_frame_limit(MAX_FRAMES);
+        for (i = 0; i < SAMPLES; ++i)
+        {
+            strcpy(paths[i], "/tmp/noobgraphics-image-XXXXXX");
+            if (!write_sample(&samples[i], paths[i]))
+                _exit(1);
+            samples[i].image = ng_load_image(paths[i]);
+        }
+        // the files are read on the loader thread while the frames run
+        ng_init_graphics(WIDTH, HEIGHT, "images", on_update, on_render);
+        for (i = 0; i < SAMPLES; ++i)
+            unlink(paths[i]);
+        _exit(check_samples(name));
+    }
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// the GL backends put the pixels in textures through the upload buffer,
+// the software one samples the pages
+int main()
+{
+    int ok = run(NG_BACKEND_SOFTWARE, "software");
+    ok &= run(NG_BACKEND_OPENGL, "OpenGL 2.0");
+    ok &= run(NG_BACKEND_GL33, "OpenGL 3.3");
+    return !ok;
+}
@@ -0,0 +1,66 @@
+#include "../src/internal.h"
+#include <stdio.h>
+
+#define STEPS 3
+
+static void on_update(int dt);
+static void on_render();
+static void push_move(int x, int y);
+static int mouse_at(int x, int y);
+
+static int step;
+static int failed;
+
+// the headless loop has no window to send events, so they are pushed
+// the way the GLUT callbacks push them
+void push_move(int x, int y)
+{
+    ng_event e = { 0 };
+    e.type = NG_EVENT_MOUSE_MOVE;
+    e.x = x;
+    e.y = y;
+    e.state = MOVED;
+    ng_input_push(&e);
+}
+
+int mouse_at(int x, int y)
+{
+    int mouse_x, mouse_y, button, state;
+    ng_get_mouse(&mouse_x, &mouse_y, &button, &state);
+    return mouse_x == x && mouse_y == y;
+}
+
+// a move pushed after the previous one was fed reaches ng_get_mouse on
+// the next update, even when the pointer stops there
+void on_update(int dt)
+{
+    (void)dt;
+    switch (step++)
+    {
+    case 0:
+        push_move(10, 20);
+        break;
+    case 1:
+        failed |= !mouse_at(10, 20);
+        push_move(30, 40);
+        break;
+    case 2:
+        failed |= !mouse_at(30, 40);
+        break;
+    }
+}
+
+void on_render()
+{
+}
+
+int main()
+{
+    ng_set_backend(NG_BACKEND_SOFTWARE);
+    ng_set_headless(1);
+    ng_set_frame_limit(STEPS);
+    ng_init_graphics(16, 16, "input", on_update, on_render);
+    int ok = step == STEPS && !failed;
+    printf("input: moves after a feed %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
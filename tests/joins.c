@@ -0,0 +1,135 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define WIDTH 200
+#define HEIGHT 200
+#define SIZE (WIDTH * HEIGHT * 4)
+/* half-transparent white on black: a pixel covered once is 128, twice
+   192 */
+#define COVERED_ONCE 128
+
+static void on_update(int dt);
+static void on_render();
+static int render(int backend, int width, int cap, unsigned char* pixels);
+static int covered_twice(const unsigned char* pixels);
+static int covered(const unsigned char* pixels, int x, int y);
+
+static int line_width;
+static int line_cap;
+
+// sharp zigzag turns are beveled, the gentle one near the end is mitered;
+// the segments are far enough apart not to overlap each other
+static const ng_point points[] = {
+    { 20, 10 }, { 180, 30 }, { 20, 50 }, { 180, 70 }, { 20, 90 },
+    { 180, 110 }, { 100, 120 }, { 180, 130 }, { 170, 190 },
+};
+
+void on_update(int dt)
+{
+    (void)dt;
+}
+
+void on_render()
+{
+    ng_set_line_cap(line_cap);
+    ng_set_color(0xFFFFFF80);
+    ng_draw_polyline(points, sizeof(points) / sizeof(points[0]), line_width);
+}
+
+// one frame from a process of its own, as ng_init_graphics runs once;
+// the pixels come back through shared memory
+int render(int backend, int width, int cap, unsigned char* pixels)
+{
+    int status;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int frame_width, frame_height;
+        line_width = width;
+        line_cap = cap;
+        ng_set_backend(backend);
+        ng_set_headless(1);
+        ng_set_frame_limit(1);
+        ng_init_graphics(WIDTH, HEIGHT, "joins", on_update, on_render);
+        const unsigned char* frame = ng_get_framebuffer(&frame_width,
+                                                        &frame_height);
+        if (frame == NULL || frame_width != WIDTH || frame_height != HEIGHT)
+            _exit(1);
+        memcpy(pixels, frame, SIZE);
+        _exit(0);
+    }
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// the pixels blended more than once
+int covered_twice(const unsigned char* pixels)
+{
+    int twice = 0, i;
+    for (i = 0; i < SIZE; i += 4)
+        twice += pixels[i] > COVERED_ONCE + 2;
+    return twice;
+}
+
+// rows come top first, y goes up
+int covered(const unsigned char* pixels, int x, int y)
+{
+    return pixels[((HEIGHT - 1 - y) * WIDTH + x) * 4] > COVERED_ONCE / 2;
+}
+
+// a translucent polyline blends once over every pixel it covers, also
+// where its segments meet and around its ends; square and round caps
+// reach 5 pixels behind the first point of a 16 wide line, butt caps
+// don't, and only square caps fill the corner 7 behind and 7 aside
+int main()
+{
+    static const int widths[] = { 3, 6, 10, 16 };
+    static const int backends[] = { NG_BACKEND_SOFTWARE, NG_BACKEND_OPENGL };
+    static const char* names[] = { "software", "OpenGL 2.0" };
+    static const char* caps[] = { "butt", "square", "round" };
+    unsigned char* pixels = mmap(NULL, SIZE, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    int failed = 0;
+    int i, j, cap;
+
+    if (pixels == MAP_FAILED)
+    {
+        printf("joins: setup FAILED\n");
+        return 1;
+    }
+    for (i = 0; i < 2; ++i)
+    {
+        for (cap = NG_CAP_BUTT; cap <= NG_CAP_ROUND; ++cap)
+        {
+            for (j = 0; j < (int)(sizeof(widths) / sizeof(widths[0])); ++j)
+            {
+                if (!render(backends[i], widths[j], cap, pixels))
+                {
+                    printf("joins: %s %s caps width %d rendering FAILED\n",
+                           names[i], caps[cap], widths[j]);
+                    failed = 1;
+                    continue;
+                }
+                int twice = covered_twice(pixels);
+                printf("joins: %s %s caps width %d %s (%d pixels covered "
+                       "twice)\n", names[i], caps[cap], widths[j],
+                       twice == 0 ? "ok" : "FAILED", twice);
+                failed |= twice != 0;
+            }
+
+            // the last render was 16 wide
+            int ok = covered(pixels, 15, 9) == (cap != NG_CAP_BUTT) &&
+                     covered(pixels, 12, 16) == (cap == NG_CAP_SQUARE);
+            printf("joins: %s %s caps end %s\n", names[i], caps[cap],
+                   ok ? "ok" : "FAILED");
+            failed |= !ok;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,171 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define WIDTH 64
+#define HEIGHT 64
+#define SIZE (WIDTH * HEIGHT * 4)
+#define MAX_FILES 64
+
+typedef struct
+{
+    char name[256];
+    ino_t inode;
+    struct timespec modified;
+} cache_file;
+
+static void on_update(int dt);
+static void on_render();
+static int render(const char* dir, unsigned char* pixels);
+static int list_cache(const char* dir, cache_file* files);
+static void remove_cache(const char* dir);
+
+void on_update(int dt)
+{
+    (void)dt;
+}
+
+// the color, line and texture programs all draw
+void on_render()
+{
+    ng_set_color(0x4080C0FF);
+    ng_draw_rectangle(4, 4, 60, 30);
+    ng_set_color(0xFFFF00FF);
+    ng_draw_line(0, 0, 63, 63, 1);
+    ng_set_color(0xFFFFFFFF);
+    ng_draw_text(4, 40, "hit");
+}
+
+// one headless OpenGL frame with the cache in dir, from a process of
+// its own
+int render(const char* dir, unsigned char* pixels)
+{
+    int status;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int width, height;
+        ng_set_program_cache(dir);
+        ng_set_backend(NG_BACKEND_OPENGL);
+        ng_set_headless(1);
+        ng_set_frame_limit(1);
+        ng_init_graphics(WIDTH, HEIGHT, "programs", on_update, on_render);
+        const unsigned char* frame = ng_get_framebuffer(&width, &height);
+        if (frame == NULL || width != WIDTH || height != HEIGHT)
+            _exit(1);
+        memcpy(pixels, frame, SIZE);
+        _exit(0);
+    }
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// the files in the cache, -1 without the directory
+int list_cache(const char* dir, cache_file* files)
+{
+    char path[512];
+    struct dirent* entry;
+    struct stat st;
+    int count = 0;
+    DIR* d = opendir(dir);
+    if (d == NULL)
+        return -1;
+    while ((entry = readdir(d)) != NULL && count < MAX_FILES)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (stat(path, &st) != 0)
+            continue;
+        snprintf(files[count].name, sizeof(files[count].name), "%s",
+                 entry->d_name);
+        files[count].inode = st.st_ino;
+        files[count].modified = st.st_mtim;
+        ++count;
+    }
+    closedir(d);
+    return count;
+}
+
+void remove_cache(const char* dir)
+{
+    char path[512];
+    struct dirent* entry;
+    DIR* d = opendir(dir);
+    if (d == NULL)
+        return;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+// the first run misses, links from source and makes the directory and
+// a file per program; the second loads them, so it leaves every file
+// as it was, and draws the same pixels. Without program binaries, or
+// without EGL, nothing is saved and there is nothing to check
+int main()
+{
+    char parent[] = "/tmp/noobgraphics-programs-XXXXXX";
+    char dir[64];
+    cache_file missed[MAX_FILES], hit[MAX_FILES];
+    unsigned char* compiled = mmap(NULL, SIZE * 2, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    unsigned char* loaded = compiled + SIZE;
+    int ok, i;
+
+    if (compiled == MAP_FAILED || mkdtemp(parent) == NULL)
+    {
+        printf("programs: setup FAILED\n");
+        return 1;
+    }
+    // a directory that doesn't exist yet
+    snprintf(dir, sizeof(dir), "%s/cache", parent);
+
+    ok = render(dir, compiled);
+    int misses = list_cache(dir, missed);
+    ok = ok && render(dir, loaded);
+    int hits = list_cache(dir, hit);
+    remove_cache(dir);
+    rmdir(parent);
+
+    if (!ok)
+    {
+        printf("programs: rendering FAILED\n");
+        return 1;
+    }
+    if (misses <= 0)
+    {
+        printf("programs: no program binaries, skipped\n");
+        return 0;
+    }
+    printf("programs: miss saved %d programs ok\n", misses);
+
+    ok = hits == misses;
+    for (i = 0; ok && i < misses; ++i)
+    {
+        ok = strcmp(hit[i].name, missed[i].name) == 0 &&
+             hit[i].inode == missed[i].inode &&
+             hit[i].modified.tv_sec == missed[i].modified.tv_sec &&
+             hit[i].modified.tv_nsec == missed[i].modified.tv_nsec;
+    }
+    printf("programs: hit left the files alone %s\n", ok ? "ok" : "FAILED");
+    if (!ok)
+        return 1;
+
+    ok = memcmp(compiled, loaded, SIZE) == 0;
+    printf("programs: loaded programs draw the same %s\n",
+           ok ? "ok" : "FAILED");
+    return !ok;
+}
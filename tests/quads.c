@@ -0,0 +1,181 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define WIDTH 320
+#define HEIGHT 240
+#define SIZE (WIDTH * HEIGHT * 4)
+/* how far a channel may be from the software frame: the GPU rounds
+   blended colors a little differently, while a quad missing or misplaced
+   is far further off */
+#define BLEND_TOLERANCE 2
+
+static void on_update(int dt);
+static void on_render();
+static int render(int backend, int threads, unsigned char* pixels);
+static int differing_pixels(const unsigned char* a, const unsigned char* b,
+                            int tolerance);
+static unsigned char* shared_frame();
+
+static ng_image* image;
+
+static const ng_point zigzag[] = {
+    { 20, 230 }, { 90, 160 }, { 110, 225 }, { 190, 170 }, { 230, 235 },
+};
+static const ng_line capped[] = {
+    { 150, 60, 200, 90, 0xFF8000C0 }, { 210, 40, 300, 40, 0x00C0FFC0 },
+};
+static const ng_point dots[] = {
+    { 5, 5 }, { 157, 118 }, { 160, 121 }, { 314, 234 }, { 64, 64 },
+};
+
+// rectangles, wide lines, glyphs and an image are all quads, polylines
+// and points are there for the tiles; capped lines are instanced on GL
+void on_update(int dt)
+{
+    static unsigned char rgba[8 * 8 * 4];
+    int i;
+    (void)dt;
+    if (image != NULL)
+        return;
+    for (i = 0; i < 8 * 8; ++i)
+    {
+        rgba[i * 4] = (unsigned char)(i * 4);
+        rgba[i * 4 + 1] = (unsigned char)(255 - i * 4);
+        rgba[i * 4 + 2] = (unsigned char)(i % 8 * 32);
+        rgba[i * 4 + 3] = 255;
+    }
+    image = ng_create_image(rgba, 8, 8);
+}
+
+void on_render()
+{
+    int i;
+    ng_set_color(0x204080FF);
+    ng_draw_rectangle(0, 0, WIDTH, HEIGHT);
+    for (i = 0; i < 40; ++i)
+    {
+        ng_set_color(0x80C04000 | (unsigned int)(i * 6 + 10));
+        ng_draw_rectangle(i * 7, i * 5, i * 7 + 60, i * 5 + 30);
+    }
+    ng_set_color(0xFFFF00FF);
+    ng_draw_line(10, 200, 300, 20, 5);
+    ng_set_color(0xFFFFFFFF);
+    ng_draw_text(12, 120, "Hello, quads 0123");
+    ng_draw_image(image, 250, 150);
+    ng_draw_image(image, 270, 150);
+    ng_set_color(0x40FF40C0);
+    ng_draw_polyline(zigzag, sizeof(zigzag) / sizeof(zigzag[0]), 4);
+    ng_set_color(0xFF40FFFF);
+    ng_draw_points(dots, sizeof(dots) / sizeof(dots[0]), 3);
+    ng_set_line_cap(NG_CAP_ROUND);
+    ng_draw_lines(capped, 1, 9);
+    ng_set_line_cap(NG_CAP_SQUARE);
+    ng_draw_lines(capped + 1, 1, 7);
+    ng_set_line_cap(NG_CAP_BUTT);
+}
+
+// renders one frame without a window in a process of its own, the
+// pixels come back through shared memory; threads only splits the
+// software frame into tiles
+int render(int backend, int threads, unsigned char* pixels)
+{
+    int status;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int width, height;
+        ng_set_backend(backend);
+        ng_set_threads(threads);
+        ng_set_headless(1);
+        ng_set_frame_limit(1);
+        ng_init_graphics(WIDTH, HEIGHT, "quads", on_update, on_render);
+        const unsigned char* frame = ng_get_framebuffer(&width, &height);
+        if (frame == NULL || width != WIDTH || height != HEIGHT)
+            _exit(1);
+        memcpy(pixels, frame, SIZE);
+        _exit(0);
+    }
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// pixels with a color channel more than tolerance apart
+int differing_pixels(const unsigned char* a, const unsigned char* b,
+                     int tolerance)
+{
+    int differing = 0;
+    int i, j;
+    for (i = 0; i < SIZE; i += 4)
+    {
+        int off = 0;
+        for (j = 0; j < 3; ++j)
+            off |= abs(a[i + j] - b[i + j]) > tolerance;
+        differing += off;
+    }
+    return differing;
+}
+
+unsigned char* shared_frame()
+{
+    unsigned char* pixels = mmap(NULL, SIZE, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return pixels != MAP_FAILED ? pixels : NULL;
+}
+
+// both GL backends draw the quads as indexed triangles, with and without
+// a vertex array and base vertex, and have to give the same pixels, which
+// cover what the software rasterizer covers; without EGL they fall back
+// to it and compare trivially. The software frame drawn in tiles by
+// several threads is the same as the one drawn by one
+int main()
+{
+    static const int threads[] = { 3, 4 };
+    unsigned char* software = shared_frame();
+    unsigned char* tiled = shared_frame();
+    unsigned char* gl20 = shared_frame();
+    unsigned char* gl33 = shared_frame();
+    int differing, i;
+
+    if (software == NULL || tiled == NULL || gl20 == NULL || gl33 == NULL ||
+        !render(NG_BACKEND_SOFTWARE, 1, software) ||
+        !render(NG_BACKEND_OPENGL, 1, gl20) ||
+        !render(NG_BACKEND_GL33, 1, gl33))
+    {
+        printf("quads: rendering FAILED\n");
+        return 1;
+    }
+
+    differing = differing_pixels(gl20, software, BLEND_TOLERANCE);
+    printf("quads: OpenGL 2.0 against software %s (%d differing pixels)\n",
+           differing == 0 ? "ok" : "FAILED", differing);
+    if (differing != 0)
+        return 1;
+    differing = differing_pixels(gl33, gl20, 0);
+    printf("quads: OpenGL 3.3 against OpenGL 2.0 %s (%d differing pixels)\n",
+           differing == 0 ? "ok" : "FAILED", differing);
+    if (differing != 0)
+        return 1;
+
+    for (i = 0; i < (int)(sizeof(threads) / sizeof(threads[0])); ++i)
+    {
+        if (!render(NG_BACKEND_SOFTWARE, threads[i], tiled))
+        {
+            printf("quads: software on %d threads rendering FAILED\n",
+                   threads[i]);
+            return 1;
+        }
+        differing = differing_pixels(tiled, software, 0);
+        printf("quads: software on %d threads against 1 %s (%d differing "
+               "pixels)\n", threads[i], differing == 0 ? "ok" : "FAILED",
+               differing);
+        if (differing != 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define WIDTH 320
+#define HEIGHT 240
+#define SIZE (WIDTH * HEIGHT * 4)
+#define FRAMES 4
+
+static void on_update(int dt);
+static void on_render();
+static int record(const char* path, unsigned char* pixels);
+static int replay(const char* path, unsigned char* pixels);
+static int finish(pid_t pid);
+
+static ng_image* image;
+static ng_geometry* geometry;
+static int mark;
+static int frames_drawn;
+
+// an image and a geometry made in the first frame, updated and drawn in
+// every one
+void on_update(int dt)
+{
+    static unsigned char rgba[6 * 4 * 4];
+    int i;
+    (void)dt;
+    if (image != NULL)
+        return;
+    for (i = 0; i < 6 * 4; ++i)
+    {
+        rgba[i * 4] = (unsigned char)(i * 10);
+        rgba[i * 4 + 1] = (unsigned char)(200 - i * 8);
+        rgba[i * 4 + 2] = 90;
+        rgba[i * 4 + 3] = (unsigned char)(i % 3 ? 255 : 128);
+    }
+    image = ng_create_image(rgba, 6, 4);
+}
+
+void on_render()
+{
+    ng_point points[16];
+    int i;
+    ++frames_drawn;
+    if (geometry == NULL)
+    {
+        geometry = ng_begin_geometry();
+        ng_set_color(0x30A030FF);
+        ng_draw_rectangle(200, 20, 300, 60);
+        mark = ng_geometry_mark();
+        ng_draw_rectangle(200, 70, 220, 90);
+        ng_end_geometry();
+    }
+    ng_begin_geometry_update(geometry, mark);
+    ng_set_color(0xC03030FF);
+    ng_draw_rectangle(200 + frames_drawn * 10, 70, 220 + frames_drawn * 10,
+                      90);
+    ng_end_geometry();
+
+    ng_set_color(0x101828FF);
+    ng_draw_rectangle(0, 100, WIDTH, HEIGHT);
+    ng_draw_geometry(geometry);
+    for (i = 0; i < 16; ++i)
+    {
+        points[i].x = 10 + i * 12;
+        points[i].y = 150 + (i * 37 + frames_drawn * 11) % 60;
+    }
+    ng_set_color(0xFFE040C0);
+    ng_draw_polyline(points, 16, 3);
+    ng_set_color(0xFFFFFFFF);
+    ng_draw_text(10, 220, "recorded");
+    ng_draw_image_scaled(image, 250, 150, 250 + frames_drawn * 12, 190);
+}
+
+// what the pixels were when the recording ended, from a process of its
+// own, like the replay
+int record(const char* path, unsigned char* pixels)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int width, height;
+        if (!ng_record_trace(path))
+            _exit(1);
+        ng_set_backend(NG_BACKEND_SOFTWARE);
+        ng_set_frame_limit(FRAMES);
+        ng_init_graphics(WIDTH, HEIGHT, "trace", on_update, on_render);
+        const unsigned char* frame = ng_get_framebuffer(&width, &height);
+        if (frame == NULL)
+            _exit(1);
+        memcpy(pixels, frame, SIZE);
+        // the trace is complete at exit
+        exit(0);
+    }
+    return finish(pid);
+}
+
+// ng_replay_trace has to come back once the frames have been drawn
+int replay(const char* path, unsigned char* pixels)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int width, height;
+        ng_set_backend(NG_BACKEND_SOFTWARE);
+        if (!ng_replay_trace(path))
+            _exit(1);
+        const unsigned char* frame = ng_get_framebuffer(&width, &height);
+        if (frame == NULL || width != WIDTH || height != HEIGHT)
+            _exit(1);
+        memcpy(pixels, frame, SIZE);
+        _exit(0);
+    }
+    return finish(pid);
+}
+
+int finish(pid_t pid)
+{
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// a recorded session replays to the same last frame
+int main()
+{
+    char path[] = "/tmp/noobgraphics-trace-XXXXXX";
+    unsigned char* recorded = mmap(NULL, SIZE * 2, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    unsigned char* replayed = recorded + SIZE;
+    int fd = mkstemp(path);
+    int ok;
+
+    if (recorded == MAP_FAILED || fd < 0)
+    {
+        printf("trace: setup FAILED\n");
+        return 1;
+    }
+    close(fd);
+    ok = record(path, recorded) && replay(path, replayed);
+    unlink(path);
+    if (!ok)
+    {
+        printf("trace: recording or replay FAILED\n");
+        return 1;
+    }
+
+    ok = memcmp(recorded, replayed, SIZE) == 0;
+    printf("trace: replayed frame %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
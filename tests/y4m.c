@@ -0,0 +1,197 @@
+#include <noobgraphics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* odd, so the chroma planes round up */
+#define WIDTH 33
+#define HEIGHT 17
+#define FRAMES 5
+/* the update step that moves the stream to another file */
+#define RESTART 2
+#define CHROMA (((WIDTH + 1) / 2) * ((HEIGHT + 1) / 2))
+#define FRAME_SIZE (WIDTH * HEIGHT + CHROMA * 2)
+
+static void on_update(int dt);
+static void on_render();
+static int stream(int backend, const char* path, const char* restart);
+static unsigned char* read_stream(const char* path, long* size);
+static int check_stream(const char* backend, const unsigned char* data,
+                        long size, int frames);
+static int run(int backend, const char* name, const char* restart);
+
+static const char* restart_path;
+static FILE* streamed;
+static int step;
+
+// stopping, closing and opening the next file hands it the same
+// descriptor, which has to start a stream of its own
+void on_update(int dt)
+{
+    (void)dt;
+    if (restart_path != NULL && step++ == RESTART)
+    {
+        int fd = fileno(streamed);
+        ng_stream_y4m(-1);
+        fclose(streamed);
+        streamed = fopen(restart_path, "wb");
+        if (streamed == NULL || fileno(streamed) != fd ||
+            !ng_stream_y4m(fd))
+            _exit(1);
+    }
+}
+
+// white in the top left corner, black elsewhere; limited range puts
+// them at 235 and 16, without color
+void on_render()
+{
+    ng_set_color(0xFFFFFFFF);
+    ng_draw_rectangle(0, HEIGHT - 8, 16, HEIGHT);
+}
+
+// the frames of a process of its own, complete at exit; with restart
+// the stream moves there after RESTART steps
+int stream(int backend, const char* path, const char* restart)
+{
+    int status;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        restart_path = restart;
+        streamed = fopen(path, "wb");
+        if (streamed == NULL || !ng_stream_y4m(fileno(streamed)))
+            _exit(1);
+        ng_set_backend(backend);
+        ng_set_headless(1);
+        ng_set_frame_limit(FRAMES);
+        ng_init_graphics(WIDTH, HEIGHT, "y4m", on_update, on_render);
+        exit(0);
+    }
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// the whole file, NULL when it is empty
+unsigned char* read_stream(const char* path, long* size)
+{
+    unsigned char* data = NULL;
+    FILE* f = fopen(path, "rb");
+    *size = 0;
+    if (f != NULL && fseek(f, 0, SEEK_END) == 0 && (*size = ftell(f)) > 0 &&
+        (data = malloc(*size)) != NULL)
+    {
+        rewind(f);
+        if (fread(data, 1, *size, f) != (size_t)*size)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    if (f != NULL)
+        fclose(f);
+    return data;
+}
+
+// the header, one frame for every update step, and the planes' sizes
+// and values
+int check_stream(const char* backend, const unsigned char* data, long size,
+                 int frames)
+{
+    char expected[128];
+    int length = snprintf(expected, sizeof(expected),
+                          "YUV4MPEG2 W%d H%d F60:1 ", WIDTH, HEIGHT);
+    const unsigned char* end = memchr(data, '\n', size);
+    if (end == NULL || memcmp(data, expected, length) != 0)
+    {
+        printf("y4m: %s header FAILED\n", backend);
+        return 0;
+    }
+
+    const unsigned char* frame = end + 1;
+    long sent = (size - (frame - data)) / (6 + FRAME_SIZE);
+    int ok = sent == frames &&
+             (frame - data) + sent * (6 + FRAME_SIZE) == size;
+    printf("y4m: %s %ld frames of %d bytes %s\n", backend, sent,
+           FRAME_SIZE, ok ? "ok" : "FAILED");
+    if (!ok)
+        return 0;
+
+    const unsigned char* y = frame + 6;
+    const unsigned char* u = y + WIDTH * HEIGHT;
+    ok = memcmp(frame, "FRAME\n", 6) == 0 && y[0] == 235 &&
+         y[WIDTH - 1] == 16 && y[WIDTH * (HEIGHT - 1)] == 16 &&
+         u[0] == 128 && u[CHROMA] == 128 && u[CHROMA * 2 - 1] == 128;
+    printf("y4m: %s planes %s\n", backend, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// the GL frames are read back bottom up and have to come out the same.
+// After a restart the first file may miss the frames still queued when
+// it stopped, the second has the steps from the restart on
+int run(int backend, const char* name, const char* restart)
+{
+    char path[] = "/tmp/noobgraphics-y4m-XXXXXX";
+    char label[64];
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        printf("y4m: %s setup FAILED\n", name);
+        return 0;
+    }
+    close(fd);
+
+    long size, restarted_size;
+    int ok = stream(backend, path, restart);
+    unsigned char* data = read_stream(path, &size);
+    unsigned char* restarted = restart != NULL
+                                   ? read_stream(restart, &restarted_size)
+                                   : NULL;
+    unlink(path);
+    if (restart != NULL)
+        unlink(restart);
+
+    if (restart == NULL)
+    {
+        if (!ok || data == NULL)
+            printf("y4m: %s streaming FAILED\n", name);
+        ok = ok && data != NULL && check_stream(name, data, size, FRAMES);
+    }
+    else
+    {
+        snprintf(label, sizeof(label), "%s restarted", name);
+        if (!ok || restarted == NULL)
+            printf("y4m: %s streaming FAILED\n", label);
+        ok = ok && restarted != NULL &&
+             check_stream(label, restarted, restarted_size,
+                          FRAMES - RESTART);
+        if (ok && data != NULL &&
+            memcmp(data, "YUV4MPEG2 ", 10) != 0)
+        {
+            printf("y4m: %s first stream FAILED\n", name);
+            ok = 0;
+        }
+    }
+    free(data);
+    free(restarted);
+    return ok;
+}
+
+int main()
+{
+    char restart[] = "/tmp/noobgraphics-y4m-XXXXXX";
+    int fd = mkstemp(restart);
+    if (fd < 0)
+    {
+        printf("y4m: setup FAILED\n");
+        return 1;
+    }
+    close(fd);
+
+    int ok = run(NG_BACKEND_SOFTWARE, "software", NULL);
+    ok &= run(NG_BACKEND_OPENGL, "OpenGL 2.0", NULL);
+    ok &= run(NG_BACKEND_SOFTWARE, "software", restart);
+    return !ok;
+}